@@ -0,0 +1,320 @@
+#include "Codec.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace mpi
+{
+namespace codec
+{//------------------------------------------------------------------------------------------------
+ // Byte-shuffle
+ //------------------------------------------------------------------------------------------------
+    void
+    shuffle(void const* src, size_t n, size_t wordSize, void* dst)
+    {
+        char const* s = (char const*)src;
+        char*       d = (char*)dst;
+        size_t nWords = n / wordSize;
+        for( size_t j = 0; j < wordSize; ++j ) {
+            char* dj = d + j*nWords;
+            for( size_t i = 0; i < nWords; ++i )
+                dj[i] = s[i*wordSize + j];
+        }
+        size_t nShuffled = nWords*wordSize;
+        std::memcpy( d + nShuffled, s + nShuffled, n - nShuffled );
+    }
+
+    void
+    unshuffle(void const* src, size_t n, size_t wordSize, void* dst)
+    {
+        char const* s = (char const*)src;
+        char*       d = (char*)dst;
+        size_t nWords = n / wordSize;
+        for( size_t j = 0; j < wordSize; ++j ) {
+            char const* sj = s + j*nWords;
+            for( size_t i = 0; i < nWords; ++i )
+                d[i*wordSize + j] = sj[i];
+        }
+        size_t nShuffled = nWords*wordSize;
+        std::memcpy( d + nShuffled, s + nShuffled, n - nShuffled );
+    }
+
+ //------------------------------------------------------------------------------------------------
+ // LZ compression
+ // The compressed data are a series of sequences. A sequence consists of
+ //   - a token byte: the high nibble is the number of literals, the low nibble is the match length - 4.
+ //     A nibble value of 15 means that the value is continued in extra bytes: bytes of 255 are added
+ //     until a byte < 255 is encountered, which is also added.
+ //   - the extra literal length bytes,
+ //   - the literals,
+ //   - the match offset (2 bytes, little endian), i.e. the distance to the start of the match,
+ //   - the extra match length bytes.
+ // The last sequence only has a token, and literals.
+ //------------------------------------------------------------------------------------------------
+    namespace
+    {
+        size_t const minMatch = 4;
+        size_t const lastLiterals = 5;     // the last bytes are always literals
+        size_t const maxOffset = 65535;
+        unsigned const hashLog = 12;
+
+        inline uint32_t read32(unsigned char const* p) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+
+        inline uint32_t hash(uint32_t v) {
+            return (v * 2654435761u) >> (32 - hashLog);
+        }
+
+     // write a length of which the first 4 bits are already in the token. Returns false if it does not fit.
+        inline bool
+        writeLength(size_t len, unsigned char*& op, unsigned char const* opEnd)
+        {
+            for( len -= 15; len >= 255; len -= 255 ) {
+                if( op >= opEnd ) return false;
+                *op++ = 255;
+            }
+            if( op >= opEnd ) return false;
+            *op++ = (unsigned char)len;
+            return true;
+        }
+
+     // read a length of which the first 4 bits are nibble. Returns false if the input is exhausted.
+        inline bool
+        readLength(size_t& len, unsigned char const*& ip, unsigned char const* ipEnd)
+        {
+            if( len != 15 ) return true;
+            unsigned char b;
+            do {
+                if( ip >= ipEnd ) return false;
+                b = *ip++;
+                len += b;
+            } while( b == 255 );
+            return true;
+        }
+
+     // write a sequence. Returns false if it does not fit.
+        inline bool
+        writeSequence
+          ( unsigned char const* literals, size_t nLiterals
+          , size_t offset, size_t matchLength // matchLength == 0 for the last sequence
+          , unsigned char*& op, unsigned char const* opEnd
+          )
+        {
+            if( op >= opEnd ) return false;
+            unsigned char* token = op++;
+            size_t ml = matchLength ? matchLength - minMatch : 0;
+            *token = (unsigned char)( (std::min<size_t>(nLiterals, 15) << 4) | std::min<size_t>(ml, 15) );
+            if( nLiterals >= 15 && !writeLength(nLiterals, op, opEnd) ) return false;
+            if( op + nLiterals > opEnd ) return false;
+            std::memcpy(op, literals, nLiterals);
+            op += nLiterals;
+            if( matchLength ) {
+                if( op + 2 > opEnd ) return false;
+                *op++ = (unsigned char)(offset & 0xff);
+                *op++ = (unsigned char)(offset >> 8);
+                if( ml >= 15 && !writeLength(ml, op, opEnd) ) return false;
+            }
+            return true;
+        }
+    }
+
+    size_t
+    compress(void const* src, size_t n, void* dst, size_t dstCapacity)
+    {
+        unsigned char const* const base = (unsigned char const*)src;
+        unsigned char const* const end  = base + n;
+        unsigned char* op = (unsigned char*)dst;
+        unsigned char const* const opEnd = op + dstCapacity;
+
+        unsigned char const* anchor = base;
+        if( n > minMatch + lastLiterals && n < uint32_t(-1) ) // positions in the hash table are 32 bit
+        {
+            std::vector<uint32_t> table(size_t(1) << hashLog, uint32_t(-1));
+            unsigned char const* const matchLimit = end - lastLiterals;
+            unsigned char const* ip = base;
+            while( ip + minMatch <= matchLimit )
+            {
+                uint32_t seq = read32(ip);
+                uint32_t& entry = table[hash(seq)];
+                uint32_t candidate = entry;
+                entry = uint32_t(ip - base);
+                bool found = candidate != uint32_t(-1)
+                          && size_t(ip - base) - candidate <= maxOffset
+                          && read32(base + candidate) == seq;
+                if( !found ) {
+                    ++ip;
+                    continue;
+                }
+             // extend the match
+                unsigned char const* ref = base + candidate;
+                size_t len = minMatch;
+                while( ip + len < matchLimit && ref[len] == ip[len] ) ++len;
+
+                if( !writeSequence(anchor, ip - anchor, ip - ref, len, op, opEnd) ) return 0;
+                ip += len;
+                anchor = ip;
+            }
+        }
+     // last literals
+        if( !writeSequence(anchor, end - anchor, 0, 0, op, opEnd) ) return 0;
+        return op - (unsigned char*)dst;
+    }
+
+    bool
+    decompress(void const* src, size_t n, void* dst, size_t dstSize)
+    {
+        unsigned char const* ip = (unsigned char const*)src;
+        unsigned char const* const ipEnd = ip + n;
+        unsigned char* const base = (unsigned char*)dst;
+        unsigned char* op = base;
+        unsigned char* const opEnd = base + dstSize;
+
+        while( ip < ipEnd )
+        {
+            unsigned char token = *ip++;
+         // literals
+            size_t nLiterals = token >> 4;
+            if( !readLength(nLiterals, ip, ipEnd) ) return false;
+            if( nLiterals > size_t(ipEnd - ip) || nLiterals > size_t(opEnd - op) ) return false;
+            std::memcpy(op, ip, nLiterals);
+            ip += nLiterals;
+            op += nLiterals;
+            if( ip == ipEnd ) break; // last sequence
+         // match
+            if( ipEnd - ip < 2 ) return false;
+            size_t offset = ip[0] | (size_t(ip[1]) << 8);
+            ip += 2;
+            size_t matchLength = token & 15;
+            if( !readLength(matchLength, ip, ipEnd) ) return false;
+            matchLength += minMatch;
+            if( offset == 0 || offset > size_t(op - base) || matchLength > size_t(opEnd - op) ) return false;
+            unsigned char const* ref = op - offset;
+            if( offset >= matchLength ) {
+                std::memcpy(op, ref, matchLength);
+                op += matchLength;
+            } else {// overlapping copy
+                for( size_t i = 0; i < matchLength; ++i ) *op++ = *ref++;
+            }
+        }
+        return op == opEnd;
+    }
+
+ //------------------------------------------------------------------------------------------------
+ // Implementation of struct Statistics
+ //------------------------------------------------------------------------------------------------
+    INFO_DEF(Statistics)
+    {
+        std::stringstream ss;
+        ss<<indent<<"codec::Statistics.info("<<title<<") :"
+          <<indent<<"  encoded    : "<<nEncoded<<" messages ("<<nCompressed<<" compressed), "
+                                     <<rawBytes<<" -> "<<frameBytes<<" bytes, ratio="<<ratio()
+                                     <<", "<<encodeTime*1e-6<<" ms"
+          <<indent<<"  decoded    : "<<nDecoded<<" messages, "<<decodeTime*1e-6<<" ms";
+        return ss.str();
+    }
+
+ //------------------------------------------------------------------------------------------------
+ // Implementation of class Codec
+ //------------------------------------------------------------------------------------------------
+    size_t
+    Codec::
+    encode(void const* message, size_t rawSize, MessageBuffer& frame)
+    {
+        using namespace std::chrono;
+        auto t0 = steady_clock::now();
+
+        frame.alloc( frameCapacity(rawSize) );
+        FrameHeader header = {};
+        header.rawSize = rawSize;
+        char* payload = (char*)frame.ptr() + sizeof(FrameHeader);
+
+        size_t payloadSize = 0;
+        if( rawSize >= threshold_ && rawSize > 1 )
+        {
+            void const* src = message;
+            if( wordSize_ > 1 ) {
+                scratch_.resize(rawSize);
+                shuffle(message, rawSize, wordSize_, scratch_.data());
+                src = scratch_.data();
+            }
+            payloadSize = compress(src, rawSize, payload, rawSize - 1); // 0 if it does not pay off
+            if( payloadSize ) {
+                header.method   = (wordSize_ > 1 ? shuffled_lz : lz);
+                header.wordSize = (uint8_t)wordSize_;
+                ++statistics_.nCompressed;
+            }
+        }
+        if( payloadSize == 0 ) {
+            header.method = raw;
+            std::memcpy(payload, message, rawSize);
+            payloadSize = rawSize;
+        }
+        std::memcpy(frame.ptr(), &header, sizeof(FrameHeader));
+        size_t frameSize = sizeof(FrameHeader) + payloadSize;
+
+        ++statistics_.nEncoded;
+        statistics_.rawBytes += rawSize;
+        statistics_.frameBytes += frameSize;
+        statistics_.encodeTime += duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+        return frameSize;
+    }
+
+    size_t
+    Codec::
+    decode(void const* frame, size_t frameSize, void* message, size_t messageCapacity)
+    {
+        using namespace std::chrono;
+        auto t0 = steady_clock::now();
+
+     // The frame comes from the network: check everything before reading or writing.
+        if( frameSize < sizeof(FrameHeader) ) return badFrame;
+        FrameHeader header;
+        std::memcpy(&header, frame, sizeof(FrameHeader));
+        if( header.rawSize > messageCapacity ) return badFrame;
+        char const* payload = (char const*)frame + sizeof(FrameHeader);
+        size_t payloadSize = frameSize - sizeof(FrameHeader);
+
+        bool ok = true;
+        switch( header.method ) {
+            case raw:
+                ok = payloadSize == header.rawSize;
+                if( ok ) std::memcpy(message, payload, header.rawSize);
+                break;
+            case lz:
+                ok = decompress(payload, payloadSize, message, header.rawSize);
+                break;
+            case shuffled_lz:
+                ok = header.wordSize > 1;
+                if( ok ) {
+                    scratch_.resize(header.rawSize);
+                    ok = decompress(payload, payloadSize, scratch_.data(), header.rawSize);
+                }
+                if( ok ) unshuffle(scratch_.data(), header.rawSize, header.wordSize, message);
+                break;
+            default:
+                ok = false;
+        }
+        if( !ok ) return badFrame;
+
+        ++statistics_.nDecoded;
+        statistics_.decodeTime += duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+        return header.rawSize;
+    }
+
+    INFO_DEF(Codec)
+    {
+        std::stringstream ss;
+        ss<<indent<<"codec::Codec.info("<<title<<") : ( enabled="<<enabled_
+                  <<", threshold="<<threshold_
+                  <<", wordSize="<<wordSize_
+                  <<" )"
+                  <<statistics_.info(indent + "  ");
+        return ss.str();
+    }
+
+ //------------------------------------------------------------------------------------------------
+}// namespace codec
+}// namespace mpi
@@ -0,0 +1,146 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "mpicts.h"
+#include "MessageBuffer.h"
+
+#include <vector>
+
+namespace mpi
+{
+namespace codec
+{//------------------------------------------------------------------------------------------------
+ // Compression of messages.
+ //
+ // A MessageHandler with an enabled Codec sends its messages as frames. A frame consists of a FrameHeader
+ // followed by the payload, which is either the message itself, or the compressed message. The message is
+ // compressed only if it is larger than a threshold, and only if that makes the frame smaller. Optionally, the
+ // message is byte-shuffled before compression: the first bytes of all words, then the second bytes of all words,
+ // etc. For arrays of floats this brings the (slowly varying) exponent bytes together, which compress a lot better.
+ // The compressor is a small LZ77 compressor with the token format of LZ4 blocks (no entropy coding), which favours
+ // speed over compression ratio.
+ //------------------------------------------------------------------------------------------------
+    enum Method : uint8_t
+    { raw         = 0 // the payload is the message
+    , lz          = 1 // the payload is the compressed message
+    , shuffled_lz = 2 // the payload is the compressed byte-shuffled message
+    };
+
+    struct FrameHeader
+    {
+        uint8_t  method;   // Method
+        uint8_t  wordSize; // word size of the byte-shuffle
+        uint16_t unused16;
+        uint32_t unused32;
+        uint64_t rawSize;  // size of the message (bytes)
+    };
+
+ //------------------------------------------------------------------------------------------------
+ // Kernels
+
+ // Byte-shuffle n bytes from src to dst, for words of wordSize bytes. Trailing bytes that do not
+ // make up a word are copied as is.
+    void shuffle  (void const* src, size_t n, size_t wordSize, void* dst);
+ // Inverse of shuffle.
+    void unshuffle(void const* src, size_t n, size_t wordSize, void* dst);
+
+    size_t                  // compressed size (bytes), 0 if the result did not fit in dstCapacity bytes
+    compress
+      ( void const* src     // data to compress
+      , size_t n            // number of bytes to compress
+      , void* dst           // destination for the compressed data
+      , size_t dstCapacity  // size of dst (bytes)
+      );
+
+    bool                    // false if the compressed data are corrupt or do not decompress to exactly dstSize bytes
+    decompress
+      ( void const* src     // compressed data
+      , size_t n            // number of compressed bytes
+      , void* dst           // destination for the decompressed data
+      , size_t dstSize      // size of the decompressed data (bytes)
+      );
+
+ //------------------------------------------------------------------------------------------------
+    struct Statistics
+ // Statistics of a Codec, to assess the trade-off between CPU time and bandwidth.
+ //------------------------------------------------------------------------------------------------
+    {
+        size_t  nEncoded = 0;       // number of messages encoded
+        size_t  nCompressed = 0;    // number of messages sent compressed
+        size_t  rawBytes = 0;       // total size of the encoded messages
+        size_t  frameBytes = 0;     // total size of the frames sent (including FrameHeaders)
+        int64_t encodeTime = 0;     // total time spent encoding (nanoseconds)
+        size_t  nDecoded = 0;       // number of messages decoded
+        int64_t decodeTime = 0;     // total time spent decoding (nanoseconds)
+
+        double ratio() const { return frameBytes ? double(rawBytes)/frameBytes : 1.0; }
+        void reset() { *this = Statistics(); }
+
+        INFO_DECL;
+    };
+
+ //------------------------------------------------------------------------------------------------
+    class Codec
+ // Encoding and decoding of message frames, with its settings and statistics.
+ // The sending and the receiving MessageHandler must have the same settings.
+ //------------------------------------------------------------------------------------------------
+    {
+        bool   enabled_;
+        size_t threshold_; // messages smaller than this are not compressed
+        size_t wordSize_;  // word size for the byte-shuffle, no byte-shuffle if < 2
+        Statistics statistics_;
+        std::vector<char> scratch_; // for the byte-shuffled message
+
+    public:
+        Codec()
+          : enabled_(false)
+          , threshold_(4096)
+          , wordSize_(sizeof(float))
+        {}
+
+        void enable
+          ( size_t threshold = 4096         // messages smaller than this (bytes) are not compressed
+          , size_t wordSize = sizeof(float) // byte-shuffle for words of this size, 0 or 1 for no byte-shuffle
+          )
+        {
+            enabled_ = true;
+            threshold_ = threshold;
+            wordSize_ = wordSize;
+        }
+        void disable() { enabled_ = false; }
+
+        bool   enabled()   const { return enabled_; }
+        size_t threshold() const { return threshold_; }
+        size_t wordSize()  const { return wordSize_; }
+        Statistics const& statistics() const { return statistics_; }
+        Statistics      & statistics()       { return statistics_; }
+
+     // The size of the largest frame for a message of rawSize bytes.
+        static size_t frameCapacity(size_t rawSize) { return rawSize + sizeof(FrameHeader); }
+
+        size_t                      // size of the frame (bytes)
+        encode
+          ( void const* message     // the message
+          , size_t rawSize          // size of the message (bytes)
+          , MessageBuffer& frame    // the frame, allocated here.
+          );
+
+     // Returned by decode() for a corrupt or truncated frame, or a message that does not fit.
+        static size_t const badFrame = size_t(-1);
+
+        size_t                      // size of the message (bytes), or badFrame
+        decode
+          ( void const* frame       // the frame
+          , size_t frameSize        // size of the frame (bytes)
+          , void* message           // destination of the message
+          , size_t messageCapacity  // size of the destination (bytes)
+          );
+
+        INFO_DECL;
+    };
+
+ //------------------------------------------------------------------------------------------------
+}// namespace codec
+}// namespace mpi
+
+#endif // CODEC_H
@@ -0,0 +1,132 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace mpi
+{
+namespace delta
+{//-------------------------------------------------------------------------------------------------
+ // Delta encoding of ghost particle updates.
+ // In set mode the same particles are sent to the same neighbour over and over, and their values
+ // change only a little between two messages. Sender and receiver keep a snapshot of the values
+ // exchanged last, and the sender transmits the XOR of the new values with the snapshot, in the
+ // style of Gorilla (Pelkonen et al. 2015). The data are treated as 32 bit words. For slowly varying
+ // floats the XOR has only leading zero bytes (equal sign, exponent and leading mantissa bits), so
+ // only its low bytes are transmitted:
+ //   - a control block with a 2 bit code per word: 0 = unchanged, 1 = 1 byte, 2 = 2 bytes, 3 = 4 bytes,
+ //   - the low bytes of the XORed words (little endian),
+ //   - the XOR of the trailing bytes that do not make up a word.
+ //-------------------------------------------------------------------------------------------------
+    enum Method : uint8_t
+    { plain    = 0 // raw values, no snapshots are kept
+    , snapshot = 1 // raw values, which become the snapshot on both sides
+    , xor_     = 2 // XOR with the snapshot, the result becomes the snapshot on both sides
+    };
+
+    inline constexpr size_t codeBytes[4] = {0, 1, 2, 4}; // number of bytes stored per code
+
+ // The code of a XORed word.
+    inline uint32_t
+    code(uint32_t x) {
+        return x == 0 ? 0 : x <= 0xff ? 1 : x <= 0xffff ? 2 : 3;
+    }
+
+ // The size of the control block for nBytes of data.
+    inline size_t controlBytes(size_t nBytes) { return (nBytes/4 + 3)/4; }
+
+ //-------------------------------------------------------------------------------------------------
+ // Encode nBytes of data cur against the snapshot prev. Returns the encoded size, or 0 if that would
+ // exceed capacity.
+    inline size_t
+    encode
+      ( void const* cur   // the new values
+      , void const* prev  // the snapshot
+      , size_t nBytes     // size of cur and prev
+      , void* dst         // destination of the encoded data
+      , size_t capacity   // size of dst (bytes)
+      )
+    {
+        char const* c = (char const*)cur;
+        char const* p = (char const*)prev;
+        unsigned char* ctrl = (unsigned char*)dst;
+        size_t const nWords = nBytes/4;
+        size_t const nCtrl  = controlBytes(nBytes);
+        size_t const nTail  = nBytes - 4*nWords;
+        if( nCtrl + nTail > capacity ) return 0;
+
+        std::memset(ctrl, 0, nCtrl);
+        unsigned char* op = ctrl + nCtrl;
+        unsigned char const* const opEnd = (unsigned char*)dst + capacity - nTail;
+        for( size_t i = 0; i < nWords; ++i )
+        {
+            uint32_t a, b;
+            std::memcpy(&a, c + 4*i, 4);
+            std::memcpy(&b, p + 4*i, 4);
+            uint32_t x = a ^ b;
+            uint32_t k = code(x);
+            size_t nb = codeBytes[k];
+            if( op + nb > opEnd ) return 0;
+            std::memcpy(op, &x, nb); // low bytes on little endian machines
+            op += nb;
+            ctrl[i >> 2] |= (unsigned char)(k << (2*(i & 3)));
+        }
+        for( size_t i = 4*nWords; i < nBytes; ++i )
+            *op++ = (unsigned char)(c[i] ^ p[i]);
+        return op - (unsigned char*)dst;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // Inverse of encode. Returns the number of bytes consumed from src.
+    inline size_t
+    decode
+      ( void const* src   // the encoded data
+      , void const* prev  // the snapshot
+      , size_t nBytes     // size of prev and dst
+      , void* dst         // destination of the decoded values (may be prev)
+      )
+    {
+        unsigned char const* ctrl = (unsigned char const*)src;
+        char const* p = (char const*)prev;
+        char*       d = (char*)dst;
+        size_t const nWords = nBytes/4;
+        unsigned char const* ip = ctrl + controlBytes(nBytes);
+        for( size_t i = 0; i < nWords; ++i )
+        {
+            uint32_t k = (ctrl[i >> 2] >> (2*(i & 3))) & 3;
+            size_t nb = codeBytes[k];
+            uint32_t x = 0, b;
+            std::memcpy(&x, ip, nb);
+            ip += nb;
+            std::memcpy(&b, p + 4*i, 4);
+            x ^= b;
+            std::memcpy(d + 4*i, &x, 4);
+        }
+        for( size_t i = 4*nWords; i < nBytes; ++i )
+            d[i] = (char)(*ip++ ^ p[i]);
+        return ip - (unsigned char const*)src;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // The number of bytes that decode would consume from src, without decoding.
+    inline size_t
+    encodedSize
+      ( void const* src   // the encoded data
+      , size_t nBytes     // size of the decoded data
+      )
+    {
+        unsigned char const* ctrl = (unsigned char const*)src;
+        size_t const nWords = nBytes/4;
+        size_t n = controlBytes(nBytes) + (nBytes - 4*nWords);
+        for( size_t i = 0; i < nWords; ++i )
+            n += codeBytes[(ctrl[i >> 2] >> (2*(i & 3))) & 3];
+        return n;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace delta
+}// namespace mpi
+
+#endif // DELTA_H
@@ -0,0 +1,170 @@
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include "mpicts.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+    class IdMap
+ // Rank local map of global particle IDs to particle indices.
+ // Open addressing with linear probing in a power of 2 table of (ID, index) pairs, which is at most
+ // half full. IDs are hashed multiplicatively (Fibonacci hashing), so consecutive IDs are spread
+ // over the table. Removal shifts the following entries of the cluster back, so there are no
+ // tombstones and lookups stay short after many migrations.
+ // find(ids, n, indices) resolves a batch of IDs: it hashes a group of IDs and prefetches their
+ // slots before probing them, so that the cache misses of the group overlap.
+ //-------------------------------------------------------------------------------------------------
+    {
+        struct Slot {
+            Id_t    id;    // -1 if the slot is empty
+            Index_t index;
+        };
+        std::vector<Slot> slots_;
+        size_t mask_;  // slots_.size() - 1
+        int    shift_; // 64 - log2(slots_.size())
+        size_t size_;  // number of IDs in the map
+        static constexpr size_t groupSize_ = 16; // number of IDs prefetched together by find(ids, n, indices)
+    public:
+        IdMap(size_t capacity = 64)
+          : size_(0)
+        {
+            rehash_(capacity);
+        }
+
+        size_t size() const { return size_; }
+        bool  empty() const { return size_ == 0; }
+
+        void
+        clear()
+        {
+            for( auto& slot : slots_ ) slot.id = -1;
+            size_ = 0;
+        }
+
+     // Make room for n IDs without rehashing.
+        void
+        reserve(size_t n)
+        {
+            if( 2*n > slots_.size() ) rehash_(2*n);
+        }
+
+     // The index of particle id, or -1 if id is not in the map.
+        inline Index_t
+        find(Id_t id) const
+        {
+            for( size_t i = home_(id); ; i = (i + 1) & mask_ ) {
+                if( slots_[i].id == id ) return slots_[i].index;
+                if( slots_[i].id == -1 ) return -1;
+            }
+        }
+
+     // The indices of n IDs (-1 for IDs that are not in the map).
+        void
+        find(Id_t const* ids, size_t n, Index_t* indices) const
+        {
+            size_t home[groupSize_];
+            for( size_t i0 = 0; i0 < n; i0 += groupSize_ )
+            {
+                size_t const m = std::min(groupSize_, n - i0);
+                for( size_t k = 0; k < m; ++k ) {
+                    home[k] = home_(ids[i0 + k]);
+                    __builtin_prefetch(&slots_[home[k]]);
+                }
+                for( size_t k = 0; k < m; ++k ) {
+                    Id_t const id = ids[i0 + k];
+                    Index_t index = -1;
+                    for( size_t i = home[k]; slots_[i].id != -1; i = (i + 1) & mask_ )
+                        if( slots_[i].id == id ) {
+                            index = slots_[i].index;
+                            break;
+                        }
+                    indices[i0 + k] = index;
+                }
+            }
+        }
+
+        Indices_t
+        find(std::vector<Id_t> const& ids) const
+        {
+            Indices_t indices(ids.size());
+            find(ids.data(), ids.size(), indices.data());
+            return indices;
+        }
+
+     // Add id, unless it is already in the map. Returns true if it was added.
+        bool
+        insert(Id_t id, Index_t index)
+        {
+            assert( id >= 0 && "Particle IDs must be non-negative." );
+            if( 2*(size_ + 1) > slots_.size() ) rehash_(2*slots_.size());
+            size_t i = home_(id);
+            for( ; slots_[i].id != -1; i = (i + 1) & mask_ )
+                if( slots_[i].id == id ) return false;
+            slots_[i] = {id, index};
+            ++size_;
+            return true;
+        }
+
+     // Change the index of id from oldIndex to newIndex. Returns false if id does not map to oldIndex.
+        bool
+        update(Id_t id, Index_t oldIndex, Index_t newIndex)
+        {
+            for( size_t i = home_(id); slots_[i].id != -1; i = (i + 1) & mask_ )
+                if( slots_[i].id == id ) {
+                    if( slots_[i].index != oldIndex ) return false;
+                    slots_[i].index = newIndex;
+                    return true;
+                }
+            return false;
+        }
+
+     // Remove id, if it maps to index. Returns true if it was removed.
+        bool
+        erase(Id_t id, Index_t index)
+        {
+            size_t i = home_(id);
+            for( ; slots_[i].id != id; i = (i + 1) & mask_ )
+                if( slots_[i].id == -1 ) return false;
+            if( slots_[i].index != index ) return false;
+         // shift the following entries of the cluster back, if that brings them closer to their home slot
+            for( size_t j = (i + 1) & mask_; slots_[j].id != -1; j = (j + 1) & mask_ )
+            {
+                size_t h = home_(slots_[j].id);
+                if( ((j - h) & mask_) >= ((j - i) & mask_) ) {
+                    slots_[i] = slots_[j];
+                    i = j;
+                }
+            }
+            slots_[i].id = -1;
+            --size_;
+            return true;
+        }
+
+    private:
+        inline size_t home_(Id_t id) const { return size_t((uint64_t(id)*0x9E3779B97F4A7C15ull) >> shift_); }
+
+        void
+        rehash_(size_t capacity)
+        {
+            size_t n = 2;
+            int log2n = 1;
+            while( n < capacity ) { n *= 2; ++log2n; }
+            std::vector<Slot> old(n, Slot{-1, -1});
+            old.swap(slots_);
+            mask_ = n - 1;
+            shift_ = 64 - log2n;
+            for( auto const& slot : old )
+                if( slot.id != -1 ) {
+                    size_t i = home_(slot.id);
+                    while( slots_[i].id != -1 ) i = (i + 1) & mask_;
+                    slots_[i] = slot;
+                }
+        }
+    };
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // IDMAP_H
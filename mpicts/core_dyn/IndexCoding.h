@@ -0,0 +1,259 @@
+#ifndef INDEXCODING_H
+#define INDEXCODING_H
+
+#include "mpicts.h"
+
+#include <cstring>
+
+namespace mpi
+{
+namespace index_coding
+{//-------------------------------------------------------------------------------------------------
+ // Compact encoding of particle selections.
+ // A selection is encoded in the smallest of the forms below, which is chosen after a single cheap
+ // scan of the indices. The order of the indices is preserved (it is the order in which the
+ // ParticleArrays are written), and the number of indices is not part of the encoding.
+ //   - ranges : runs of consecutive indices, as (start, length) pairs of varints, the start relative
+ //              to the end of the previous run (zigzag),
+ //   - bitmap : for strictly increasing indices, the first index and the span as varints, followed
+ //              by one bit per index in the span,
+ //   - deltas : the differences of successive indices as zigzag varints,
+ //   - int32  : 32 bit indices, if all indices are in [0, 2^32[,
+ //   - int64  : Index_t as is.
+ // The encoding is preceded by a Method byte.
+ //-------------------------------------------------------------------------------------------------
+    enum Method : uint8_t
+    { ranges = 0
+    , bitmap = 1
+    , deltas = 2
+    , int32  = 3
+    , int64  = 4
+    };
+
+ //-------------------------------------------------------------------------------------------------
+ // Varints (LEB128), and zigzag encoding of signed values.
+    inline uint64_t zigzag  (int64_t  v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+    inline int64_t  unzigzag(uint64_t u) { return int64_t(u >> 1) ^ -int64_t(u & 1); }
+
+    inline size_t
+    varintSize(uint64_t u)
+    {
+        size_t n = 1;
+        while( u >= 0x80 ) { u >>= 7; ++n; }
+        return n;
+    }
+
+    inline void
+    writeVarint(uint64_t u, unsigned char*& p)
+    {
+        while( u >= 0x80 ) {
+            *p++ = (unsigned char)(u | 0x80);
+            u >>= 7;
+        }
+        *p++ = (unsigned char)u;
+    }
+
+    inline uint64_t
+    readVarint(unsigned char const*& p)
+    {
+        uint64_t u = 0;
+        for( unsigned shift = 0; ; shift += 7 ) {
+            unsigned char b = *p++;
+            u |= uint64_t(b & 0x7f) << shift;
+            if( !(b & 0x80) ) return u;
+        }
+    }
+
+ //-------------------------------------------------------------------------------------------------
+    struct Choice
+ // The result of the scan: the smallest encoding and its size, including the Method byte.
+ //-------------------------------------------------------------------------------------------------
+    {
+        Method method;
+        size_t size;
+    };
+
+    inline Choice
+    choose
+      ( Indices_t const& indices
+      )
+    {
+        size_t const n = indices.size();
+        size_t nRanges = 0, nDeltas = 0;
+        bool increasing = true, fits32 = true;
+        Index_t prev = 0, runStart = 0;
+        for( size_t i = 0; i < n; ++i )
+        {
+            Index_t index = indices[i];
+            fits32 = fits32 && index >= 0 && uint64_t(index) <= 0xffffffffu;
+            if( i > 0 ) increasing = increasing && index > prev;
+            nDeltas += varintSize( zigzag(index - prev) );
+            if( i == 0 || index != prev + 1 )
+            {// a new run
+                if( i > 0 ) nRanges += varintSize( uint64_t(prev + 1 - runStart) ); // length of the previous run
+                nRanges += varintSize( zigzag(index - (i ? prev + 1 : 0)) );
+                runStart = index;
+            }
+            prev = index;
+        }
+        if( n ) nRanges += varintSize( uint64_t(prev + 1 - runStart) );
+
+        Choice best = { int64, n*sizeof(Index_t) };
+        if( fits32 && 4*n < best.size ) best = { int32, 4*n };
+        if( nDeltas < best.size ) best = { deltas, nDeltas };
+        if( nRanges < best.size ) best = { ranges, nRanges };
+        if( increasing && n ) {
+            uint64_t span = uint64_t(indices.back() - indices.front()) + 1;
+            size_t nBitmap = varintSize( zigzag(indices.front()) ) + varintSize(span) + (span + 7)/8;
+            if( nBitmap < best.size ) best = { bitmap, nBitmap };
+        }
+        best.size += sizeof(Method);
+        return best;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // The number of bytes the encoded indices will occupy (exact).
+    inline size_t
+    encodedSize
+      ( Indices_t const& indices
+      )
+    {
+        return choose(indices).size;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // Encode the indices at pos, and advance pos.
+    inline void
+    encode
+      ( Indices_t const& indices
+      , void*& pos
+      )
+    {
+        Choice choice = choose(indices);
+        unsigned char* p = (unsigned char*)pos;
+        *p++ = choice.method;
+        size_t const n = indices.size();
+        switch( choice.method )
+        {
+            case ranges: {
+                Index_t next = 0; // the index following the previous run
+                for( size_t i = 0; i < n; )
+                {
+                    size_t j = i + 1;
+                    while( j < n && indices[j] == indices[j-1] + 1 ) ++j;
+                    writeVarint( zigzag(indices[i] - next), p );
+                    writeVarint( j - i, p );
+                    next = indices[j-1] + 1;
+                    i = j;
+                }
+                break;
+            }
+            case bitmap: {
+                Index_t first = indices.front();
+                uint64_t span = uint64_t(indices.back() - first) + 1;
+                writeVarint( zigzag(first), p );
+                writeVarint( span, p );
+                std::memset(p, 0, (span + 7)/8);
+                for( auto index : indices ) {
+                    uint64_t bit = uint64_t(index - first);
+                    p[bit >> 3] |= (unsigned char)(1u << (bit & 7));
+                }
+                p += (span + 7)/8;
+                break;
+            }
+            case deltas: {
+                Index_t prev = 0;
+                for( auto index : indices ) {
+                    writeVarint( zigzag(index - prev), p );
+                    prev = index;
+                }
+                break;
+            }
+            case int32: {
+                for( auto index : indices ) {
+                    uint32_t i32 = uint32_t(index);
+                    std::memcpy(p, &i32, 4);
+                    p += 4;
+                }
+                break;
+            }
+            case int64:
+                if( n ) std::memcpy(p, indices.data(), n*sizeof(Index_t));
+                p += n*sizeof(Index_t);
+                break;
+        }
+        assert( size_t(p - (unsigned char*)pos) == choice.size && "Inconsistent index encoding size." );
+        pos = p;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // Decode n indices from pos, and advance pos.
+    inline void
+    decode
+      ( void*& pos
+      , size_t n
+      , Indices_t& indices
+      )
+    {
+        unsigned char const* p = (unsigned char const*)pos;
+        Method method = Method(*p++);
+        indices.resize(n);
+        switch( method )
+        {
+            case ranges: {
+                Index_t next = 0;
+                for( size_t i = 0; i < n; )
+                {
+                    Index_t start = next + unzigzag( readVarint(p) );
+                    size_t length = readVarint(p);
+                    assert( i + length <= n && "Corrupt index encoding." );
+                    for( size_t k = 0; k < length; ++k )
+                        indices[i++] = start + Index_t(k);
+                    next = start + Index_t(length);
+                }
+                break;
+            }
+            case bitmap: {
+                Index_t first = unzigzag( readVarint(p) );
+                uint64_t span = readVarint(p);
+                size_t i = 0;
+                for( uint64_t byte = 0; byte < (span + 7)/8; ++byte ) {
+                    for( unsigned bits = p[byte]; bits; bits &= bits - 1 )
+                        indices[i++] = first + Index_t(8*byte + __builtin_ctz(bits));
+                }
+                assert( i == n && "Corrupt index encoding." );
+                p += (span + 7)/8;
+                break;
+            }
+            case deltas: {
+                Index_t prev = 0;
+                for( size_t i = 0; i < n; ++i ) {
+                    prev += unzigzag( readVarint(p) );
+                    indices[i] = prev;
+                }
+                break;
+            }
+            case int32: {
+                for( size_t i = 0; i < n; ++i ) {
+                    uint32_t i32;
+                    std::memcpy(&i32, p, 4);
+                    indices[i] = Index_t(i32);
+                    p += 4;
+                }
+                break;
+            }
+            case int64:
+                if( n ) std::memcpy(indices.data(), p, n*sizeof(Index_t));
+                p += n*sizeof(Index_t);
+                break;
+            default:
+                assert(false && "Corrupt index encoding.");
+        }
+        pos = (void*)p;
+    }
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace index_coding
+}// namespace mpi
+
+#endif // INDEXCODING_H
@@ -0,0 +1,150 @@
+#ifndef MEMORYPOLICY_H
+#define MEMORYPOLICY_H
+
+#include "mpicts.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#if defined(__linux__)
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+    struct MemoryPolicy
+ // Where and how the memory of an array is allocated (see PolicyAllocator). On dual socket nodes
+ // the pages of an array end up on the socket of the thread that first touches them, which is
+ // not necessarily the socket of the threads that pack and unpack the array.
+ //   - hugePages         : align the memory to 2 MiB and ask for transparent huge pages, which
+ //                         reduces the TLB misses of gathers and scatters over large arrays,
+ //   - firstTouchThreads : touch the pages in parallel with this many threads, so that they are
+ //                         spread over the sockets like the threads (0: the allocating thread),
+ //   - numaNode          : bind the pages to this NUMA node with mbind (-1: no binding).
+ // Binding is done before the pages are touched. allocateMemory() throws std::invalid_argument if
+ // numaNode is not a node of this machine, and std::system_error if mbind fails.
+ //-------------------------------------------------------------------------------------------------
+    {
+        bool hugePages = false;
+        int  firstTouchThreads = 0;
+        int  numaNode = -1;
+
+        bool operator==(MemoryPolicy const& other) const {
+            return hugePages == other.hugePages && firstTouchThreads == other.firstTouchThreads && numaNode == other.numaNode;
+        }
+        bool operator!=(MemoryPolicy const& other) const { return !(*this == other); }
+
+        static MemoryPolicy huge()                     { MemoryPolicy p; p.hugePages = true;         return p; }
+        static MemoryPolicy firstTouch(int nThreads)   { MemoryPolicy p; p.firstTouchThreads = nThreads; return p; }
+        static MemoryPolicy node(int numaNode)         { MemoryPolicy p; p.numaNode = numaNode;      return p; }
+    };
+
+    size_t const hugePageSize = size_t(1) << 21;
+
+ // The number of NUMA nodes of this machine (1 if that is unknown).
+    inline int
+    nNumaNodes()
+    {
+        int n = 0;
+#if defined(__linux__)
+        while( n < 1024 && access( concatenate("/sys/devices/system/node/node", n).c_str(), F_OK ) == 0 ) ++n;
+#endif
+        return n ? n : 1;
+    }
+
+ // Allocate nBytes according to policy. The memory is released with deallocateMemory(p, nBytes, policy).
+    inline void*
+    allocateMemory(size_t nBytes, MemoryPolicy const& policy)
+    {
+        if( !nBytes ) return nullptr;
+        size_t pageSize = 4096;
+#if defined(__linux__)
+        pageSize = sysconf(_SC_PAGESIZE);
+#endif
+        int const nNodes = policy.numaNode >= 0 ? nNumaNodes() : 1;
+        if( policy.numaNode >= nNodes || policy.numaNode >= 64 ) // the node mask below has 64 bits
+            throw std::invalid_argument( concatenate("MemoryPolicy: NUMA node ", policy.numaNode, " does not exist (", nNodes, " nodes)") );
+        size_t const alignment = policy.hugePages ? hugePageSize : pageSize;
+        size_t const size = (nBytes + alignment - 1)/alignment*alignment;
+        void* p = std::aligned_alloc(alignment, size);
+        if( !p ) throw std::bad_alloc();
+#if defined(__linux__)
+        if( policy.hugePages )
+            madvise(p, size, MADV_HUGEPAGE);
+        if( policy.numaNode >= 0 && nNodes > 1 ) // (binding to the only node is a no-op)
+        {// MPOL_BIND = 2
+            unsigned long mask = 1ul << policy.numaNode;
+            if( syscall(SYS_mbind, p, size, 2, &mask, 8*sizeof(mask) + 1, 0) != 0 ) {
+                int const error = errno;
+                std::free(p);
+                trace::record(trace::memory, trace::error, trace::memory_allocated, size, uint64_t(policy.numaNode));
+                throw std::system_error( error, std::generic_category(), concatenate("MemoryPolicy: mbind to NUMA node ", policy.numaNode, " failed") );
+            }
+        }
+#endif
+        if( policy.firstTouchThreads > 0 )
+        {// every thread touches a contiguous range of pages
+            size_t const nPages = size/pageSize;
+            int const nThreads = std::min<size_t>(policy.firstTouchThreads, nPages);
+            std::vector<std::thread> threads;
+            for( int t = 0; t < nThreads; ++t )
+                threads.emplace_back( [=]{
+                    for( size_t page = nPages*t/nThreads; page < nPages*(t + 1)/nThreads; ++page )
+                        static_cast<char*>(p)[page*pageSize] = 0;
+                });
+            for( auto& thread : threads ) thread.join();
+        }
+        trace::record(trace::memory, trace::debug, trace::memory_allocated, size, uint64_t(int64_t(policy.numaNode)));
+        return p;
+    }
+
+    inline void
+    deallocateMemory(void* p, size_t /*nBytes*/, MemoryPolicy const& /*policy*/)
+    {
+        std::free(p);
+    }
+
+ //-------------------------------------------------------------------------------------------------
+    template<typename T>
+    class PolicyAllocator
+ // A standard allocator that allocates according to a MemoryPolicy, e.g. for a ParticleArray:
+ //     ParticleArray<float, std::vector<float, PolicyAllocator<float>>> a("a", pc, PolicyAllocator<float>(MemoryPolicy::node(1)));
+ // or, shorter, PolicyParticleArray<float> (see mpacts/ParticleContainer.h). The policy is part of the
+ // allocator's state, so it is kept when the array grows.
+ //-------------------------------------------------------------------------------------------------
+    {
+        MemoryPolicy policy_;
+        template<typename U> friend class PolicyAllocator;
+    public:
+        using value_type = T;
+
+        PolicyAllocator(MemoryPolicy const& policy = MemoryPolicy()) : policy_(policy) {}
+        template<typename U>
+        PolicyAllocator(PolicyAllocator<U> const& other) : policy_(other.policy_) {}
+
+        MemoryPolicy const& policy() const { return policy_; }
+
+        T* allocate(size_t n) {
+            return static_cast<T*>( allocateMemory(n*sizeof(T), policy_) );
+        }
+        void deallocate(T* p, size_t n) {
+            deallocateMemory(p, n*sizeof(T), policy_);
+        }
+
+        template<typename U>
+        bool operator==(PolicyAllocator<U> const& other) const { return policy_ == other.policy_; }
+        template<typename U>
+        bool operator!=(PolicyAllocator<U> const& other) const { return policy_ != other.policy_; }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // MEMORYPOLICY_H
@@ -3,31 +3,60 @@
 
 #include "mpicts.h"
 
+#include <cstdint>
+#include <new>
 #include <vector>
 
 namespace mpi
 {//------------------------------------------------------------------------------------------------
  // padBytes function
  //------------------------------------------------------------------------------------------------
-//    template
-//      < size_t WordSize // Pad the nBytes parameter to the next WordSize boundary
-//      , size_t Unit=1   // Express the result as a multiple of Unit bytes (Unit must be a divisor of WordSize).
-//      >
-//    size_t              // the result
-//    padBytes            // padBytes<8>(5)   -> 8 : the next 8 byte boundary of 5 (bytes) is 8 (bytes)
-//                        // padBytes<8,4>(5) -> 2 : the next 8 byte boundary of 5 (bytes) is 2 4-byte words (= 8 bytes)
-//                        // padBytes<8,2>(5) -> 8 : the next 8 byte boundary of 5 (bytes) is 1 8-byte word (= 8 bytes)
-//      ( size_t nBytes   // the number of bytes to be padded.
-//      )
-//    {
-//        static_assert(WordSize % Unit == 0); // Unit must be a divisor of WordSize.
-//        return ((nBytes + WordSize - 1) / WordSize) * (WordSize / Unit);
-//    }
+    template
+      < size_t WordSize // Pad the nBytes parameter to the next WordSize boundary
+      , size_t Unit=1   // Express the result as a multiple of Unit bytes (Unit must be a divisor of WordSize).
+      >
+    constexpr
+    size_t              // the result
+    padBytes            // padBytes<8>(5)   -> 8 : the next 8 byte boundary of 5 (bytes) is 8 (bytes)
+                        // padBytes<8,4>(5) -> 2 : the next 8 byte boundary of 5 (bytes) is 2 4-byte words (= 8 bytes)
+                        // padBytes<8,2>(5) -> 4 : the next 8 byte boundary of 5 (bytes) is 4 2-byte words (= 8 bytes)
+      ( size_t nBytes   // the number of bytes to be padded.
+      )
+    {
+        static_assert(WordSize % Unit == 0); // Unit must be a divisor of WordSize.
+        return ((nBytes + WordSize - 1) / WordSize) * (WordSize / Unit);
+    }
+
+ // Same, for a WordSize that is only known at runtime. The result is in bytes.
+    inline size_t
+    padBytes
+      ( size_t nBytes   // the number of bytes to be padded.
+      , size_t wordSize // a power of 2
+      )
+    {
+        return (nBytes + wordSize - 1) & ~(wordSize - 1);
+    }
+
+ // Advance pointer p to the next multiple of alignment (a power of 2).
+    inline void*
+    alignPtr
+      ( void* p
+      , size_t alignment
+      )
+    {
+        return (void*)padBytes( (uintptr_t)p, alignment );
+    }
 
  //------------------------------------------------------------------------------------------------
     class MessageBuffer
+ // The buffer is aligned to MessageBuffer::alignment bytes, so that MessageItems can align their data
+ // (see MessageItemList::setAlignment()).
  //------------------------------------------------------------------------------------------------
     {
+    public:
+        static constexpr size_t alignment = 64; // cache line and AVX-512 vector size
+
+    private:
         size_t nBytes_;
         char* pBuffer_; // pointer to the beginning of the buffer
 
@@ -37,11 +66,35 @@ namespace mpi
           , pBuffer_( nullptr )
         {}
 
+     // A MessageBuffer owns its memory, it can be moved (e.g. into a MessageView) but not copied.
+        MessageBuffer(MessageBuffer const&) = delete;
+        MessageBuffer& operator=(MessageBuffer const&) = delete;
+
+        MessageBuffer(MessageBuffer&& other)
+          : nBytes_(other.nBytes_)
+          , pBuffer_(other.pBuffer_)
+        {
+            other.nBytes_ = 0;
+            other.pBuffer_ = nullptr;
+        }
+
+        MessageBuffer& operator=(MessageBuffer&& other)
+        {
+            if( this != &other ) {
+                free();
+                nBytes_  = other.nBytes_;
+                pBuffer_ = other.pBuffer_;
+                other.nBytes_ = 0;
+                other.pBuffer_ = nullptr;
+            }
+            return *this;
+        }
+
         void alloc(size_t nBytes)
         {
             if( nBytes > nBytes_) {
                 free();
-                pBuffer_ = new char[nBytes];
+                pBuffer_ = new (std::align_val_t(alignment)) char[nBytes];
                 nBytes_ = nBytes;
             } else
             {// buffer is larger than needed but that doesn't harm.
@@ -51,7 +104,8 @@ namespace mpi
         void free()
         {
             if( pBuffer_ ) {
-                delete[] pBuffer_;
+                ::operator delete[](pBuffer_, std::align_val_t(alignment));
+                pBuffer_ = nullptr;
                 nBytes_ = 0;
             }
         }
@@ -16,6 +16,8 @@ namespace mpi
     protected:
         MessageHeader messageHeader_;
         MessageBuffer messageBuffer_;
+        MessageBuffer frameBuffer_; // the message frame, if the message is sent compressed (see Codec.h)
+        size_t        frameSize_;   // the size of the message frame
     public:
         using Key_t = MessageHeader::Key_t;
 
@@ -26,6 +28,7 @@ namespace mpi
           , Key_t key // MessageHandler key
           )
           : messageHeader_(src,dst,key)
+          , frameSize_(0)
         {// messageBuffer_ remains empty, sofar.
         }
 
@@ -34,6 +37,7 @@ namespace mpi
           , size_t i // location in MessageHeaderContainer for MPI rank src
           )
           : messageHeader_(src, i)
+          , frameSize_(0)
         {
             allocateBuffer();
         }
@@ -52,6 +56,12 @@ namespace mpi
 
         void*   bufferPtr()  const { return messageBuffer_.ptr(); }
         size_t  bufferSize() const { return messageBuffer_.size(); } // the size of the buffer, >= the size of the message
+     // Hand over the MessageBuffer (e.g. to a MessageView). A new one is allocated for the next message.
+        MessageBuffer releaseBuffer() { return std::move(messageBuffer_); }
+
+        MessageBuffer& frameBuffer()       { return frameBuffer_; }
+        size_t         frameSize()   const { return frameSize_; }
+        size_t&        frameSize()         { return frameSize_; }
 
         virtual INFO_DECL;
     };
@@ -132,7 +132,11 @@ namespace mpi
     computeMessageBufferSizes()
     {
         for( auto pMessageData : sendMessages_ ) {
-            messageItemList().computeMessageBufferSize(pMessageData);
+            size_t nBytes = computeMessageBufferSize_(pMessageData);
+            if( codec_.enabled() )
+            {// The receiver needs room for the largest possible frame.
+                pMessageData->size() = codec::Codec::frameCapacity(nBytes);
+            }
         }
     }
 
@@ -151,27 +155,42 @@ namespace mpi
                 ));
             }
 
-         // write the message to the buffer
-            messageItemList().write(pMessageData);
+         // write the message to the buffer. Only the bytes written are sent, the receiver's buffer
+         // has room for pMessageData->size() bytes, which is an upper bound.
+            size_t nBytesWritten = writeMessage_(pMessageData);
+            trace::record(trace::message, trace::info, trace::message_written, nBytesWritten, key_);
             if constexpr(mpi::_debug_&&_debug_) {
                 prdbg( concatenate( pMessageData->info("\n","MessageHandler::sendMessages(): message written to buffer")
                 ));
             }
 
+         // compress the message
+            void*  sendPtr  = pMessageData->bufferPtr();
+            size_t sendSize = nBytesWritten;
+            if( codec_.enabled() )
+            {
+                size_t rawSize = nBytesWritten;
+                pMessageData->frameSize() = codec_.encode(sendPtr, rawSize, pMessageData->frameBuffer());
+                sendPtr  = pMessageData->frameBuffer().ptr();
+                sendSize = pMessageData->frameSize();
+                trace::record(trace::message, trace::info, trace::message_compressed, rawSize, sendSize);
+            }
+
          // send the message
             if( mpi::size > 1 )
             {
                 MPI_Request request;
                 int success =
                 MPI_Isend                       // non-blocking send
-                  ( pMessageData->bufferPtr()   // pointer to buffer to send
-                  , pMessageData->size()        // number of Index_t elements to send
+                  ( sendPtr                     // pointer to buffer to send
+                  , sendSize                    // number of bytes to send
                   , MPI_CHAR
                   , pMessageData->dst()         // the destination
                   , pMessageData->tag()         // the tag
                   , MPI_COMM_WORLD
                   , &request
                   );
+                trace::record(trace::message, trace::info, trace::message_sent, sendSize, pMessageData->dst());
              // todo: We have a problem if a MessageHandler does more than one send with the same destination:
              // Then source and tag=key are no longer unique. This is probable happen for a
              // ParticleContainerMessageHandler sending ghost particles and leaving particles in a separate go.
@@ -204,51 +223,131 @@ namespace mpi
         }
 
         for( auto pMessageData : recvMessages_ )
-        {// allocate buffer for this message
-            pMessageData->allocateBuffer();
+        {// receive the message
+            recvMessage_(pMessageData);
+        }
+
+        prepareRead_();
+
+        for( auto pMessageData : recvMessages_ )
+        {// read the message from the buffer
             if constexpr(mpi::_debug_&&_debug_) {
-                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() buffer allocated")
+                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() reading message from buffer")
                 ));
             }
-
-         // Receive the message
+            readMessage_(pMessageData);
+            trace::record(trace::message, trace::info, trace::message_read, pMessageData->size(), key_);
             if constexpr(mpi::_debug_&&_debug_) {
-                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() receiving message ")
-                             , "\n  MPI_Recv("
-                             , "\n    ", pMessageData->bufferPtr() // pointer to buffer where to store the message
-                             , "\n    nBytes=", pMessageData->size()      // number of elements to receive
-                             , "\n    MPI_CHAR"
-                             , "\n    src=", pMessageData->src()       // source rank
-                             , "\n    tag=", pMessageData->key()       // tag
-                             , "\n    MPI_COMM_WORLD"
-                             , "\n    MPI_STATUS_IGNORE"
-                             , "\n  );"
+                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() done")
                 ));
             }
-            int succes =
+        }
+    }
+
+ //------------------------------------------------------------------------------------------------
+    std::vector<MessageView>
+    MessageHandler::
+    recvMessageViews() // Receive the messages and return views of them
+    {
+        std::vector<MessageView> views;
+        views.reserve( recvMessages_.size() );
+        for( auto pMessageData : recvMessages_ )
+        {
+            recvMessage_(pMessageData);
+            views.emplace_back( messageItemList(), pMessageData );
+            trace::record(trace::message, trace::info, trace::message_read, pMessageData->size(), key_);
+        }
+        return views;
+    }
+
+ //------------------------------------------------------------------------------------------------
+    void
+    MessageHandler::
+    recvMessage_(MessageData* pMessageData)
+    {// allocate buffer for this message
+        pMessageData->allocateBuffer();
+        if constexpr(mpi::_debug_&&_debug_) {
+            prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() buffer allocated")
+            ));
+        }
+
+     // Receive the message
+        if constexpr(mpi::_debug_&&_debug_) {
+            prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() receiving message ")
+                         , "\n  MPI_Recv("
+                         , "\n    ", pMessageData->bufferPtr() // pointer to buffer where to store the message
+                         , "\n    nBytes=", pMessageData->size()      // number of elements to receive
+                         , "\n    MPI_CHAR"
+                         , "\n    src=", pMessageData->src()       // source rank
+                         , "\n    tag=", pMessageData->key()       // tag
+                         , "\n    MPI_COMM_WORLD"
+                         , "\n    MPI_STATUS_IGNORE"
+                         , "\n  );"
+            ));
+        }
+        if( codec_.enabled() )
+        {// receive the message frame, and decompress it
+            pMessageData->frameBuffer().alloc( pMessageData->size() );
+            MPI_Status status;
+            MPI_Recv
+              ( pMessageData->frameBuffer().ptr() // pointer to buffer where to store the message frame
+              , pMessageData->size()              // maximum number of bytes to receive
+              , MPI_CHAR
+              , pMessageData->src()               // source rank
+              , pMessageData->tag()               // tag
+              , MPI_COMM_WORLD
+              , &status
+              );
+            int count;
+            MPI_Get_count(&status, MPI_CHAR, &count);
+            pMessageData->frameSize() = count;
+            trace::record(trace::message, trace::info, trace::message_received, count, pMessageData->src());
+            size_t rawSize = codec_.decode( pMessageData->frameBuffer().ptr(), count, pMessageData->bufferPtr(), pMessageData->bufferSize() );
+            if( rawSize == codec::Codec::badFrame ) {
+                printf("%s corrupt message frame (%d bytes) received from rank %d.\n", CINFO, count, pMessageData->src());
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        else
+        {
+            MPI_Status status;
             MPI_Recv
               ( pMessageData->bufferPtr() // pointer to buffer where to store the message
-              , pMessageData->size()      // number of elements to receive
+              , pMessageData->size()      // maximum number of bytes to receive
               , MPI_CHAR
               , pMessageData->src()       // source rank
               , pMessageData->tag()       // tag
               , MPI_COMM_WORLD
-              , MPI_STATUS_IGNORE
+              , &status
               );
-
-         // read the message from the buffer
-            if constexpr(mpi::_debug_&&_debug_) {
-                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() reading message from buffer")
-                ));
-            }
-            messageItemList().read(pMessageData);
-            if constexpr(mpi::_debug_&&_debug_) {
-                prdbg( concatenate( pMessageData->info("\n", "MessageHandler::recvMessages() done")
-                ));
-            }
+            int count;
+            MPI_Get_count(&status, MPI_CHAR, &count);
+            trace::record(trace::message, trace::info, trace::message_received, count, pMessageData->src());
         }
     }
 
+ //------------------------------------------------------------------------------------------------
+    size_t
+    MessageHandler::
+    computeMessageBufferSize_(MessageData* pMessageData) const
+    {
+        return messageItemList().computeMessageBufferSize(pMessageData);
+    }
+
+    size_t
+    MessageHandler::
+    writeMessage_(MessageData* pMessageData) const
+    {
+        return messageItemList().write(pMessageData);
+    }
+
+    void
+    MessageHandler::
+    readMessage_(MessageData* pMessageData)
+    {
+        messageItemList().read(pMessageData);
+    }
+
  //------------------------------------------------------------------------------------------------
     void MessageHandler::sendAllMessages()
     {
@@ -277,6 +376,7 @@ namespace mpi
 
         ss<<indent<<"MessageHandler.info("<<"key="<<key_<<") :"
                   <<messageItemList().info(indent + "  ")
+                  <<codec_.info(indent + "  ")
           <<indent<<"  sendMessages_ :";
         if( sendMessages_.size()) {
             for( size_t m = 0; m < sendMessages_.size(); ++m ) {
@@ -4,7 +4,9 @@
 
 #include "mpicts.h"
 #include "MessageItemList.h"
+#include "MessageView.h"
 #include "MessageData.h"
+#include "Codec.h"
 
 #include <map>
 
@@ -76,6 +78,7 @@ namespace mpi
     protected: // data
         mutable MessageItemList messageItemList_; // the entries reference the objects from which the message is composed
         Key_t key_; // Identification key of the MessageHandler in the registry.
+        codec::Codec codec_; // Compression of the messages, disabled by default.
 
         MessageHandler();
     public:
@@ -89,6 +92,12 @@ namespace mpi
 
         inline MessageHandlerRegistry::Key_t key() const { return key_; }
 
+     // Compression of messages. Enable it on both the sending and the receiving end:
+     //     hndlr.codec().enable(threshold, wordSize);
+     // Statistics are in hndlr.codec().statistics().
+        inline codec::Codec const& codec() const { return codec_; }
+        inline codec::Codec      & codec()       { return codec_; }
+
         INFO_DECL;
         STATIC_INFO_DECL;
 
@@ -110,8 +119,29 @@ namespace mpi
          // receive the messages in the receive buffers, and read them into their objects
          // (receives only the messages for this MessageHandler)
 
+        std::vector<MessageView> recvMessageViews();
+         // receive the messages in the receive buffers, and return a read-only MessageView of each, instead
+         // of reading them into their objects. The MessageViews own the buffers.
+         // (receives only the messages for this MessageHandler, which must compose them with its MessageItemList)
+
         static void sendAllMessages(); // Send all message from all registered MessageHandlers
         static void recvAllMessages(); // Receive all message for all registered MessageHandlers
+
+    protected:
+     // Composition of a single message. By default these forward to the messageItemList_. Derived
+     // MessageHandlers may override them to compose their messages differently (e.g. StaticMessageHandler).
+     // They are called once per message, not once per MessageItem.
+     // computeMessageBufferSize_ returns an upper bound, writeMessage_ the actual number of bytes written.
+        virtual size_t computeMessageBufferSize_(MessageData* pMessageData) const;
+        virtual size_t writeMessage_(MessageData* pMessageData) const;
+        virtual void   readMessage_ (MessageData* pMessageData);
+     // Called by recvMessages() after all messages are received, before any is read, e.g. to reserve memory
+     // for everything the messages will add. Does nothing by default.
+        virtual void   prepareRead_() {}
+
+    private:
+     // Receive a single message in its receive buffer (and decompress it).
+        void recvMessage_(MessageData* pMessageData);
     };
  //------------------------------------------------------------------------------------------------
 }// namespace mpi
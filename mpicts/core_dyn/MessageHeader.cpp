@@ -156,6 +156,7 @@ namespace mpi
      // Before the MessageHeaders can be broadcasted, the buffer sizes must be computed and stored in the
      // MessageHeaders!
         MessageHeaderContainer& myHeaders = theHeaders[mpi::rank];
+        trace::record(trace::header, trace::info, trace::headers_broadcast, myHeaders.size());
         for( size_t i = 0; i < myHeaders.size(); ++ i ) // loop over all MessageHeaders created by this rank
         {
             MessageHeaderData& messageHeaderData = myHeaders[i];
@@ -224,7 +225,8 @@ namespace mpi
                     MessageHeaderContainer& srcHeaders = theHeaders[src];
                     for( size_t i = 0; i < srcHeaders.size(); ++i ) {// loop over all message from src
                         if( srcHeaders[i].dst == mpi::rank ) {// this is a message for me
-                            prdbg(concatenate(mpi::rank, " receiving from ", src, " i=", i));
+                            if constexpr(mpi::_debug_&&_debug_)
+                                prdbg(concatenate(mpi::rank, " receiving from ", src, " i=", i));
                             MessageHandler& hndlr = MessageHandler::theMessageHandlerRegistry[srcHeaders[i].key];
                             hndlr.addRecvMessage(src, i);
                         }
@@ -19,6 +19,19 @@ namespace mpi
 
     void
     MessageItemList::
+    setAlignment
+      ( size_t alignment
+      )
+    {
+        assert( alignment && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of 2." );
+        assert( alignment <= MessageBuffer::alignment && "Alignment exceeds that of the MessageBuffer." );
+        alignment_ = alignment;
+        for( auto pItem : list_ )
+            pItem->setAlignment(alignment);
+    }
+
+    size_t // the number of bytes written
+    MessageItemList::
     write
       ( MessageData* pMessageData
       ) const
@@ -28,8 +41,14 @@ namespace mpi
         MessageItemBase * const * pBegin = &list_[0];
         MessageItemBase * const * pEnd   = pBegin + list_.size();
         for( MessageItemBase * const * p = pBegin; p < pEnd; ++p) {
+            bufferPos = alignPtr(bufferPos, alignment_);
+            void* itemPos = bufferPos;
             (*p)->write( bufferPos, pMessageData );
+            trace::record(trace::item, trace::debug, trace::item_written, (char*)bufferPos - (char*)itemPos);
         }
+        size_t nBytes = (char*)bufferPos - (char*)pMessageData->bufferPtr();
+        assert( nBytes <= pMessageData->size() && "Message larger than computed by computeMessageBufferSize()." );
+        return nBytes;
     }
 
     void
@@ -43,7 +62,26 @@ namespace mpi
         MessageItemBase ** pBegin = &list_[0];
         MessageItemBase ** pEnd   = pBegin + list_.size();
         for( MessageItemBase ** p = pBegin; p < pEnd; ++p) {
+            bufferPos = alignPtr(bufferPos, alignment_);
+            void* itemPos = bufferPos;
             (*p)->read( bufferPos, pMessageData );
+            trace::record(trace::item, trace::debug, trace::item_read, (char*)bufferPos - (char*)itemPos);
+        }
+    }
+
+    void
+    MessageItemList::
+    view
+      ( MessageData* pMessageData
+      , std::vector<ItemView>& itemViews
+      ) const
+    {
+        itemViews.clear();
+        itemViews.resize(list_.size());
+        void* bufferPos = pMessageData->bufferPtr();
+        for( size_t i = 0; i < list_.size(); ++i ) {
+            bufferPos = alignPtr(bufferPos, alignment_);
+            list_[i]->view( bufferPos, pMessageData, itemViews[i] );
         }
     }
 
@@ -54,8 +92,8 @@ namespace mpi
       ) const
     {
         size_t sz = 0;
-        for( auto pItem : list_) {
-            sz += pItem->computeItemBufferSize(pMessageData);
+        for( auto pItem : list_) {// padded, so that the next item starts aligned
+            sz += padBytes( pItem->computeItemBufferSize(pMessageData), alignment_ );
         }
         pMessageData->size() = sz;
         //prdbg(pMessageData->info());
@@ -6,12 +6,40 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <typeinfo>
 
 namespace mpi
 {//-------------------------------------------------------------------------------------------------
+    struct ItemView
+ // The location of the values of a MessageItem in a received MessageBuffer (see MessageView).
+ //-------------------------------------------------------------------------------------------------
+    {
+        char const* data = nullptr;           // the first value, nullptr if the values are not available
+                                              // in place (e.g. delta encoded or in reduced precision)
+        size_t size = 0;                      // the number of values
+        size_t stride = 0;                    // the distance between successive values (bytes)
+        std::type_info const* type = nullptr; // the type of the values
+        char const* ends = nullptr;           // for variable size values (e.g. ParticleArray<std::vector<U>>):
+        size_t nEnds = 0;                     // the table of cumulative sizes (size_t) of the nEnds elements,
+                                              // the values are those of all elements
+        std::vector<char> decoded;            // values that are stored in the view rather than in the MessageBuffer
+
+        template<typename T>
+        void
+        setInPlace(void const* p, size_t n, size_t stride_ = sizeof(T)) {
+            data = (char const*)p;
+            size = n;
+            stride = stride_;
+            type = &typeid(T);
+        }
+    };
+
+ //-------------------------------------------------------------------------------------------------
     class MessageItemBase
  //-------------------------------------------------------------------------------------------------
         {
+    protected:
+        size_t alignment_ = 1; // alignment of the item and its data blocks in the MessageBuffer (bytes)
     public:
         virtual ~MessageItemBase() {}
     // write the message item to pos
@@ -20,8 +48,23 @@ namespace mpi
         virtual void read ( void*& pos, MessageData* pMessageData ) = 0;
     // get the size of the message item (in bytes)
         virtual size_t computeItemBufferSize( MessageData const* pMessageData ) const = 0;
+    // locate the values of the message item at pos, without reading them, and advance pos as read() would.
+        virtual void view( void*& /*pos*/, MessageData* /*pMessageData*/, ItemView& /*itemView*/ ) const
+        {
+            assert(false && "This MessageItem does not support views.");
+        }
 
         virtual INFO_DECL = 0;
+
+     // The alignment is set by the MessageItemList. The item itself starts at a multiple of alignment() bytes
+     // in the MessageBuffer. Items with array data may align these too, with alignPos() and padded().
+        void setAlignment(size_t alignment) { alignment_ = alignment; }
+        size_t alignment() const { return alignment_; }
+    protected:
+     // Advance pos to the next multiple of alignment() (the MessageBuffer is aligned to MessageBuffer::alignment).
+        void alignPos(void*& pos) const { pos = alignPtr(pos, alignment_); }
+     // The size of nBytes written at the start of the item, including the padding that aligns what follows.
+        size_t padded(size_t nBytes) const { return padBytes(nBytes, alignment_); }
     };
 
  //-------------------------------------------------------------------------------------------------
@@ -74,6 +117,27 @@ namespace mpi
             return ::mpi::computeItemBufferSize(*ptrT_);
         }
 
+     // Locate the value at pos. Packed and nested values are skipped, they are not available in place.
+        virtual void view( void*& pos, MessageData* /*pMessageData*/, ItemView& itemView ) const
+        {
+            if constexpr(internal::packed_memcpy_able<T>::value) {
+                pos = (char*)pos + internal::packed_size<T>();
+            }
+            else if constexpr(internal::fixed_size_memcpy_able<T>::value) {
+                itemView.setInPlace<T>(pos, 1);
+                pos = (char*)pos + sizeof(T);
+            }
+            else if constexpr(internal::variable_size_memcpy_able<T>::value) {
+                size_t n;
+                ::mpi::read( n, pos );
+                itemView.setInPlace<typename T::value_type>(pos, n);
+                pos = (char*)pos + n*sizeof(typename T::value_type);
+            }
+            else if constexpr(internal::nested_memcpy_able<T>::value) {
+                internal::skip_level<T>(1, pos);
+            }
+        }
+
         virtual INFO_DECL
         {
             std::stringstream ss;
@@ -89,12 +153,22 @@ namespace mpi
         static bool const _debug_ = true;
 
         std::vector<MessageItemBase*> list_;
+        size_t alignment_ = 1;
 
     public:
         ~MessageItemList();
 
         size_t size() const { return list_.size(); }
 
+     // Aligned layout: every item starts at a multiple of alignment bytes in the MessageBuffer, and items
+     // with array data (MessageItem<ParticleArray<T>>, MessageItem<ParticleContainer>) align their data
+     // blocks too, so that a receiver can access them in place, e.g. with an Eigen::Map or aligned SIMD
+     // loads. The cost is the padding bytes. alignment must be a power of 2, not larger than
+     // MessageBuffer::alignment, and the same on the sending and the receiving side. The default, 1, is the
+     // packed layout.
+        void setAlignment(size_t alignment);
+        size_t alignment() const { return alignment_; }
+
      // Add a simple item to the message
         template<typename T>
         MessageItem<T>* // Return the constructed MessageItem.
@@ -105,6 +179,7 @@ namespace mpi
           )
         {
             MessageItem<T>* p = new MessageItem<T>(t);
+            p->setAlignment(alignment_);
             list_.push_back(p);
             return p;
         }
@@ -120,16 +195,21 @@ namespace mpi
           )
         {
             MessageItem<T>* p = new MessageItem<T>(t, pOtherItem);
+            p->setAlignment(alignment_);
             list_.push_back(p);
             return p;
         }
 
-     // Write the message to a buffer at ptr.
-        void write(MessageData* pMessageData) const;
+     // Write the message to a buffer at ptr. Returns the number of bytes written, which may be less than
+     // computeMessageBufferSize() if MessageItems encode their data (the latter is an upper bound).
+        size_t write(MessageData* pMessageData) const;
 
      // Read the message from ptr in buffer
         void read(MessageData* pMessageData);
 
+     // Locate the items of the message in the buffer, without reading them (see MessageView).
+        void view(MessageData* pMessageData, std::vector<ItemView>& itemViews) const;
+
      // Compute the number of bytes the message occupies in a MessageBuffer.
         size_t
         computeMessageBufferSize
@@ -0,0 +1,124 @@
+#ifndef MESSAGEVIEW_H
+#define MESSAGEVIEW_H
+
+#include "MessageItemList.h"
+
+#include <cstring>
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+    template<typename T>
+    class Span
+ // Read-only access to n values of type T in a MessageBuffer. The values need not be aligned, unless
+ // the message has an aligned layout (see MessageItemList::setAlignment()).
+ //-------------------------------------------------------------------------------------------------
+    {
+        char const* data_;
+        size_t size_;
+        size_t stride_; // bytes
+    public:
+        Span(char const* data, size_t size, size_t stride)
+          : data_(data)
+          , size_(size)
+          , stride_(stride)
+        {}
+
+        size_t size() const { return size_; }
+        bool  empty() const { return size_ == 0; }
+
+     // The i-th value (copied, as it may be unaligned).
+        T
+        operator[](size_t i) const
+        {
+            T t;
+            std::memcpy( (void*)&t, data_ + i*stride_, sizeof(T) );
+            return t;
+        }
+
+     // True if the values are contiguous, false if they are interleaved with other values (particle_major layout).
+        bool contiguous() const { return stride_ == sizeof(T); }
+     // True if the values can be accessed in place through data().
+        bool aligned() const { return (uintptr_t)data_ % alignof(T) == 0; }
+     // A pointer to the values, e.g. for an Eigen::Map. The values must be contiguous and aligned.
+        T const*
+        data() const
+        {
+            assert( contiguous() && aligned() && "Span is not accessible in place." );
+            return (T const*)data_;
+        }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+    class MessageView
+ // Read-only access to the items of a received message, without reading them into their objects.
+ // This is for consumers that only look at the received values once (diagnostics, estimates,
+ // visualization, ...). The MessageView takes over the MessageBuffer from the MessageData, and frees
+ // it when it is destroyed. Item i of the view corresponds to MessageItem i of the MessageItemList.
+ // Items whose values are encoded (delta encoding, reduced precision, packed structs, nested containers)
+ // are not available in place, their values must be obtained by reading the message. Note that a set
+ // mode message that is delta encoded must be read, otherwise the snapshots of the sender and the
+ // receiver diverge.
+ //
+ // Usage:
+ //     std::vector<MessageView> views = hndlr.recvMessageViews();
+ //     for( auto const& view : views ) {
+ //         Span<float> m = view.span<float>(2);
+ //         ...
+ //     }
+ //-------------------------------------------------------------------------------------------------
+    {
+        MessageBuffer buffer_;
+        std::vector<ItemView> items_;
+        int src_;
+    public:
+     // Create a view of the message in pMessageData's buffer, which is moved into the view.
+        MessageView
+          ( MessageItemList const& messageItemList // the MessageItemList that composed the message
+          , MessageData* pMessageData
+          )
+          : src_(pMessageData->src())
+        {
+            messageItemList.view(pMessageData, items_);
+            buffer_ = pMessageData->releaseBuffer(); // the memory is not moved
+        }
+
+        MessageView(MessageView&&) = default;
+        MessageView& operator=(MessageView&&) = default;
+
+        int src() const { return src_; }
+
+     // The number of items.
+        size_t size() const { return items_.size(); }
+
+        ItemView const& item(size_t i) const { return items_[i]; }
+
+     // True if the values of item i are available in the view.
+        bool available(size_t i) const { return items_[i].data != nullptr; }
+
+     // The values of item i, which must be of type T.
+        template<typename T>
+        Span<T>
+        span(size_t i) const
+        {
+            ItemView const& itemView = items_[i];
+            assert( itemView.data && "The values of this item are not available in place." );
+            assert( *itemView.type == typeid(T) && "Wrong value type for this item." );
+            return Span<T>(itemView.data, itemView.size, itemView.stride);
+        }
+
+     // The cumulative sizes of the elements of item i, which has variable size values.
+        Span<size_t>
+        ends(size_t i) const
+        {
+            ItemView const& itemView = items_[i];
+            assert( itemView.ends && "This item does not have variable size values." );
+            return Span<size_t>(itemView.ends, itemView.nEnds, sizeof(size_t));
+        }
+
+        MessageBuffer const& buffer() const { return buffer_; }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // MESSAGEVIEW_H
@@ -0,0 +1,225 @@
+#ifndef PAGEDARRAY_H
+#define PAGEDARRAY_H
+
+#include "memcpy_able.h"
+
+#include <memory>
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+    template<typename T, size_t PageBytes = 1 << 16>
+    class PagedArray
+ // An array of T in fixed size pages, with a page table. Growing allocates new pages only, so the
+ // elements never move and pointers to them remain valid (as opposed to a std::vector, which
+ // reallocates and copies all elements, temporarily needing memory for both copies). Elements are
+ // accessed with operator[] (a shift and a mask on the index). Pages hold a power of 2 of elements
+ // and are aligned to 64 bytes, so that the span of a page can be processed with SIMD instructions.
+ // New elements are value initialized, as in a std::vector.
+ //-------------------------------------------------------------------------------------------------
+    {
+    public:
+        using value_type = T;
+     // The number of elements in a page: the largest power of 2 that fits in PageBytes, at least 1.
+        static constexpr size_t pageShift = []{
+            size_t shift = 0;
+            while( (size_t(2) << shift)*sizeof(T) <= PageBytes ) ++shift;
+            return shift;
+        }();
+        static constexpr size_t pageSize = size_t(1) << pageShift;
+        static constexpr size_t pageMask = pageSize - 1;
+    private:
+        struct alignas(64) Page_ { T data[pageSize]; };
+        std::vector<std::unique_ptr<Page_>> pages_; // the page table
+        size_t size_;
+    public:
+        PagedArray(size_t n = 0) : size_(0) { resize(n); }
+
+        PagedArray(PagedArray const& other)
+          : size_(0)
+        {
+            resize(other.size_);
+            for( size_t p = 0; p < nPages(); ++p )
+                std::copy(other.page(p), other.page(p) + pageSize, page(p));
+        }
+
+        PagedArray& operator=(PagedArray const& other) {
+            if( this != &other ) {
+                resize(other.size_);
+                for( size_t p = 0; p < nPages(); ++p )
+                    std::copy(other.page(p), other.page(p) + pageSize, page(p));
+            }
+            return *this;
+        }
+
+        size_t size()     const { return size_; }
+        bool   empty()    const { return size_ == 0; }
+        size_t capacity() const { return pages_.size()*pageSize; }
+
+        T&       operator[](size_t i)       { return pages_[i >> pageShift]->data[i & pageMask]; }
+        T const& operator[](size_t i) const { return pages_[i >> pageShift]->data[i & pageMask]; }
+
+     // The page table.
+        size_t   nPages()         const { return (size_ + pageMask) >> pageShift; }
+        T*       page(size_t p)         { return pages_[p]->data; }
+        T const* page(size_t p)   const { return pages_[p]->data; }
+
+     // Resize to n elements. Existing elements do not move. Pages are only released by shrink_to_fit().
+        void
+        resize(size_t n)
+        {
+            if( n < size_ )
+            {// reset the elements beyond the new size, they are value initialized when the array grows again
+                for( size_t i = n; i < size_; ++i )
+                    (*this)[i] = T();
+            }
+            size_t const nPagesNeeded = (n + pageMask) >> pageShift;
+            if( nPagesNeeded > pages_.size() ) {
+                pages_.reserve( std::max(nPagesNeeded, pages_.size() + pages_.size()/2) );
+                while( pages_.size() < nPagesNeeded )
+                    pages_.emplace_back( new Page_() );
+            }
+            size_ = n;
+        }
+
+        void
+        assign(size_t n, T const& value)
+        {
+            resize(n);
+            forEachPage( [&value](T* span, size_t m, size_t) { std::fill(span, span + m, value); } );
+        }
+
+     // Release the pages beyond the size.
+        void
+        shrink_to_fit()
+        {
+            pages_.resize( nPages() );
+            pages_.shrink_to_fit();
+        }
+
+     // Call f(span, n, first) for the elements [first, first + n[ of every page in [begin, end[.
+        template<typename F>
+        void
+        forEachPage(F f, size_t begin, size_t end)
+        {
+            while( begin < end ) {
+                size_t const n = std::min(end, (begin | pageMask) + 1) - begin;
+                f( &(*this)[begin], n, begin );
+                begin += n;
+            }
+        }
+        template<typename F> void forEachPage(F f) { forEachPage(f, 0, size_); }
+
+     //---------------------------------------------------------------------------------------------
+        template<typename A, typename R>
+        class Iterator
+     // A forward iterator, for range based for loops and the standard algorithms.
+     //---------------------------------------------------------------------------------------------
+        {
+            A* a_;
+            size_t i_;
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = T;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = R*;
+            using reference         = R&;
+            Iterator(A* a, size_t i) : a_(a), i_(i) {}
+            R& operator*()  const { return (*a_)[i_]; }
+            R* operator->() const { return &(*a_)[i_]; }
+            Iterator& operator++() { ++i_; return *this; }
+            Iterator operator++(int) { Iterator it = *this; ++i_; return it; }
+            bool operator==(Iterator const& other) const { return i_ == other.i_; }
+            bool operator!=(Iterator const& other) const { return i_ != other.i_; }
+        };
+        using iterator       = Iterator<PagedArray, T>;
+        using const_iterator = Iterator<PagedArray const, T const>;
+
+        iterator       begin()       { return iterator(this, 0); }
+        iterator       end()         { return iterator(this, size_); }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end()   const { return const_iterator(this, size_); }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+ // Bulk transfer of selected elements of a PagedArray (see write_n and read_n in memcpy_able.h). The
+ // message format is the same as for a std::vector. For fixed_size_memcpy_able types the selection is
+ // split in runs of indices on the same page, which are transferred by the kernels of write_n and
+ // read_n, with the indices relative to the page.
+ //-------------------------------------------------------------------------------------------------
+    namespace internal
+    {
+     // Call f(page, local, n) for the successive runs of indices that are on the same page. local are
+     // the indices relative to the page.
+        template<typename A, typename F>
+        void
+        forEachPageRun(A& a, Indices_t const& indices, F f)
+        {
+            size_t const n = indices.size();
+            Indices_t local( std::min(n, A::pageSize) );
+            size_t i = 0;
+            while( i < n )
+            {
+                size_t const p = size_t(indices[i]) >> A::pageShift;
+                size_t j = i;
+                for( ; j < n && size_t(indices[j]) >> A::pageShift == p && j - i < local.size(); ++j )
+                    local[j - i] = indices[j] & Index_t(A::pageMask);
+                f( a.page(p), local.data(), j - i );
+                i = j;
+            }
+        }
+    }// namespace internal
+
+    template <typename T, size_t P>
+    void write_n(PagedArray<T,P> const& a, Indices_t const& indices, void*& dst)
+    {
+        if constexpr(internal::fixed_size_memcpy_able<T>::value && !internal::packed_memcpy_able<T>::value)
+            internal::forEachPageRun( a, indices, [&dst](T const* page, Index_t const* local, size_t n) {
+                write_n(page, local, n, dst);
+            });
+        else if constexpr(internal::level_memcpy_able<T>::value) {
+            std::vector<T const*> level(indices.size());
+            for( size_t i = 0; i < indices.size(); ++i ) level[i] = &a[indices[i]];
+            if( !level.empty() ) internal::write_level<T>(level, dst);
+        } else {
+            for( auto index : indices )
+                internal::memcpy_traits<T>::write( const_cast<T&>(a[index]), dst );
+        }
+    }
+
+    template <typename T, size_t P>
+    void read_n(PagedArray<T,P>& a, Indices_t const& indices, void*& src)
+    {
+        if constexpr(internal::fixed_size_memcpy_able<T>::value && !internal::packed_memcpy_able<T>::value)
+            internal::forEachPageRun( a, indices, [&src](T* page, Index_t const* local, size_t n) {
+                read_n(page, local, n, src);
+            });
+        else if constexpr(internal::level_memcpy_able<T>::value) {
+            std::vector<T*> level(indices.size());
+            for( size_t i = 0; i < indices.size(); ++i ) level[i] = &a[indices[i]];
+            if( !level.empty() ) internal::read_level<T>(level, src);
+        } else {
+            for( auto index : indices )
+                internal::memcpy_traits<T>::read( a[index], src );
+        }
+    }
+
+    template <typename T, size_t P>
+    size_t computeBufferSize_n(PagedArray<T,P> const& a, Indices_t const& indices)
+    {
+        if constexpr(internal::packed_memcpy_able<T>::value || internal::fixed_size_memcpy_able<T>::value)
+            return indices.size() * fixedItemBufferSize<T>();
+        else if constexpr(internal::variable_size_memcpy_able<T>::value) {
+            size_t nValues = 0;
+            for( auto index : indices ) nValues += a[index].size();
+            return indices.size() * sizeof(size_t) + nValues * sizeof(typename T::value_type);
+        } else {
+            std::vector<T const*> level(indices.size());
+            for( size_t i = 0; i < indices.size(); ++i ) level[i] = &a[indices[i]];
+            return level.empty() ? 0 : internal::computeLevelBufferSize<T>(level);
+        }
+    }
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // PAGEDARRAY_H
@@ -25,26 +25,41 @@ namespace mpi
  // Implementation of class PcMessageHandler
  //---------------------------------------------------------------------------------------------------------------------
     PcMessageHandler::
-    PcMessageHandler(ParticleContainer& pc)
+    PcMessageHandler(ParticleContainer& pc, std::vector<std::string> const& arrayNames)
       : pc_(pc)
     {
      // Add the particle container subset
-     // The corresponding MessageItem will only write the number of indices.
+     // The corresponding MessageItem writes the number of particles and their IDs.
         ptr_pc_message_item_ = messageItemList().push_back(pc_);
      // Add the arrays
-     // todo: use list of names as argument and a suitable default.
-        messageItemList().push_back(pc_.r, ptr_pc_message_item_);
-        messageItemList().push_back(pc_.m, ptr_pc_message_item_);
+        for( auto const& name : arrayNames )
+            addParticleArray(name);
     }
 
     PcMessageHandler&
     PcMessageHandler::
     create(ParticleContainer& pc)
     {
-        PcMessageHandler* pPcMessageHandler = new PcMessageHandler(pc);
+        return create(pc, pc.arrayNames());
+    }
+
+    PcMessageHandler&
+    PcMessageHandler::
+    create(ParticleContainer& pc, std::vector<std::string> const& arrayNames)
+    {
+        PcMessageHandler* pPcMessageHandler = new PcMessageHandler(pc, arrayNames);
         return *pPcMessageHandler;
     }
 
+    void
+    PcMessageHandler::
+    addParticleArray(std::string const& name)
+    {
+        ParticleArrayBase* pArray = pc_.array(name);
+        assert( pArray && "No ParticleArray with this name." );
+        pArray->addToMessages(*this);
+    }
+
     void
     PcMessageHandler::
     addSendMessage
@@ -56,6 +71,22 @@ namespace mpi
         sendMessages_.push_back(new PcMessageData( mpi::rank, destination, this->key_, selection, mode ));
     }
 
+    void
+    PcMessageHandler::
+    prepareRead_()
+    {// MessageItem<ParticleContainer> is the first item, so it is at the start of the (aligned) buffer.
+        size_t nNew = 0, nGhosts = 0; // copies become ghosts
+        for( auto pMessageData : recvMessages_ ) {
+            void const* pos = pMessageData->bufferPtr();
+            size_t n = MessageItem<ParticleContainer>::nNewParticles(pos);
+            if( MessageItem<ParticleContainer>::peekMode(pos) == copy ) nGhosts += n;
+            else                                                        nNew    += n;
+        }
+        pc_.reserve(nNew);
+        pc_.reserveGhosts(nGhosts);
+        trace::record(trace::particles, trace::debug, trace::particles_reserved, nNew + nGhosts, pc_.capacity());
+    }
+
     void
     PcMessageHandler::
     addRecvMessage(int src, size_t i)
@@ -3,6 +3,13 @@
 #include <Eigen/Geometry> //?
 
 #include "mpicts.h"
+#include "Precision.h"
+#include "Delta.h"
+#include "IndexCoding.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
 
 // Here, the true mpacts ParticleContainer and ParticleArray must be included
 // this is just a stub
@@ -46,12 +53,34 @@ namespace mpi
         }
     }
 
+ //-------------------------------------------------------------------------------------------------
+    enum Layout : uint8_t
+ // Layout of the ParticleArrays in ParticleContainer Messages
+ //-------------------------------------------------------------------------------------------------
+    { array_major    // the selected elements of the first array, then those of the second array, ...
+    , particle_major // all arrays of the first selected particle, then all arrays of the second, ...
+    };
+
+    std::string
+    str( Layout layout )
+    {
+        switch(layout) {
+            case array_major   : return "array_major";
+            case particle_major: return "particle_major";
+            default:
+                assert(false && "Unknwown layout");
+        }
+    }
+
  //------------------------------------------------------------------------------------------------
     class PcMessageData : public MessageData
  //------------------------------------------------------------------------------------------------
     {
         Indices_t indices_;
+        size_t    nMissing_; // the number of indices that are -1 in a received set message (see MessageItem<ParticleContainer>::read)
         Mode      mode_;
+        Layout    layout_; // the layout of the message, as written or read by MessageItem<ParticleContainer>
+        char const* particleMajorData_; // the particle_major block of a message that is viewed (see MessageView)
 
     public:
         PcMessageData
@@ -63,7 +92,10 @@ namespace mpi
           )
           : MessageData(src, dst, key)
           , indices_(selected)
+          , nMissing_(0)
           , mode_(mode)
+          , layout_(array_major)
+          , particleMajorData_(nullptr)
         {}
 
         PcMessageData  // Create MessageData for receiving a message
@@ -71,17 +103,41 @@ namespace mpi
           , size_t i // location in MessageHeaderContainer for MPI rank src
           )
           : MessageData(src, i)
+          , nMissing_(0)
           , mode_(none)
+          , layout_(array_major)
+          , particleMajorData_(nullptr)
         {}
 
         Mode  mode() const { return mode_; }
         Mode& mode()       { return mode_; }
+        Layout  layout() const { return layout_; }
+        Layout& layout()       { return layout_; }
+        char const*  particleMajorData() const { return particleMajorData_; }
+        char const*& particleMajorData()       { return particleMajorData_; }
         Indices_t const& indices() const { return indices_; }
         Indices_t      & indices()       { return indices_; }
+        size_t  nMissing() const { return nMissing_; }
+        size_t& nMissing()       { return nMissing_; }
 
         virtual INFO_DECL;
     };
 
+ //------------------------------------------------------------------------------------------------
+    class ParticleArrayItemBase : public MessageItemBase
+ // Type erased access to the MessageItem of a ParticleArray, for MessageItem<ParticleContainer>
+ // to transfer the arrays in particle_major layout.
+ //------------------------------------------------------------------------------------------------
+    {
+    public:
+     // The address of the first array element. (Not cached, as the array may be reallocated.)
+        virtual char* arrayData() const = 0;
+     // The size of an array element (bytes).
+        virtual size_t elementSize() const = 0;
+     // True if the array can be transferred as raw elements in mode (no encoding, full precision).
+        virtual bool isPlain(Mode mode) const = 0;
+    };
+
  //------------------------------------------------------------------------------------------------
     template <>
     class MessageItem<ParticleContainer> : public MessageItemBase
@@ -92,14 +148,35 @@ namespace mpi
 
     private: // data members
         ParticleContainer* ptr_pc_;
+        Layout layout_;                                  // the requested layout
+        std::vector<ParticleArrayItemBase*> arrayItems_; // the MessageItems of the ParticleArrays (not owned)
     public:
      // ctor
         MessageItem
           ( ParticleContainer& pc
           )
           : ptr_pc_(&pc)
+          , layout_(array_major)
         {}
 
+     // Register the MessageItem of a ParticleArray, for particle_major layout.
+        void addArrayItem(ParticleArrayItemBase* pArrayItem) { arrayItems_.push_back(pArrayItem); }
+
+     // Request a layout. particle_major is only used if all arrays are plain in the mode of the message,
+     // otherwise the message falls back to array_major.
+        void setLayout(Layout layout) { layout_ = layout; }
+        Layout layout() const { return layout_; }
+
+     // The layout actually used for messages in mode.
+        Layout
+        effectiveLayout(Mode mode) const
+        {
+            if( layout_ == array_major || arrayItems_.empty() ) return array_major;
+            for( auto pArrayItem : arrayItems_ )
+                if( !pArrayItem->isPlain(mode) ) return array_major;
+            return particle_major;
+        }
+
      // dtor
         virtual
         ~MessageItem()
@@ -109,8 +186,9 @@ namespace mpi
             }
         }
 
-     // Write the number of selected particles to the MessageBuffer. This is all the reader has to know
-     // (how many new particles must be created). Remove the particle from the ParticleContainer if requested.
+     // Write the number of selected particles and their global IDs to the MessageBuffer. In set mode the reader
+     // translates the IDs to its own indices, otherwise it creates new particles with these IDs. Remove the
+     // particles from the ParticleContainer if requested.
         virtual
         void
         write
@@ -128,24 +206,29 @@ namespace mpi
             size_t nParticles = pPcMessageData->indices().size();
             ::mpi::write( nParticles, pos );
             ::mpi::write( pPcMessageData->mode(), pos );
+            pPcMessageData->layout() = effectiveLayout(pPcMessageData->mode());
+            ::mpi::write( pPcMessageData->layout(), pos );
             if constexpr(::mpi::_debug_ && _debug_) {
                 prdbg( concatenate( "MessageItem<ParticleContainer>::write(): indices.size(), mode written" ));
             }
 
-            if( pPcMessageData->mode() == set )
-            {// also write the indices
-             // TODO: We ought to write particle IDs, which on the receiving end must be translated back into indices.
-                ::mpi::write( pPcMessageData->indices(), pos );
+         // write the IDs, compactly encoded (local indices mean nothing to the receiver)
+            index_coding::encode( ptr_pc_->ids(pPcMessageData->indices()), pos );
+            if constexpr(::mpi::_debug_ && _debug_) {
+                prdbg( concatenate( "MessageItem<ParticleContainer>::write(): IDs written" ));
+            }
 
-                if constexpr(::mpi::_debug_ && _debug_) {
-                    prdbg( concatenate( "MessageItem<ParticleContainer>::write(): indices written" ));
-                }
+            if( pPcMessageData->layout() == particle_major )
+            {// write the arrays (before the particles are removed)
+                alignPos(pos);
+                writeParticleMajor_(pos, pPcMessageData->indices());
             }
 
             if( pPcMessageData->mode() == move )
             {// Remove the particles from the ParticleContainer
                 for( auto index : pPcMessageData->indices() )
                     ptr_pc_->remove(index);
+                trace::record(trace::particles, trace::debug, trace::particles_removed, pPcMessageData->indices().size());
                 if constexpr(::mpi::_debug_ && _debug_) {
                     prdbg( concatenate( "MessageItem<ParticleContainer>::write(): selection removed in sender" ));
                 }
@@ -157,7 +240,10 @@ namespace mpi
 
         virtual
         void
-        read // Read the number of selected particles and create as many new particles in the ParticleContainer.
+        read // Read the number of selected particles and their IDs. In set mode, look up the particles with these IDs,
+             // in copy mode append as many ghosts to the ParticleContainer, in move mode create as many new
+             // owned particles. In set mode, IDs that are not on this rank (anymore), e.g. of a ghost that was
+             // cleared or a particle that migrated, get index -1: their values are skipped by the array items.
           ( void*& pos
           , MessageData* pMessageData
           )
@@ -173,16 +259,21 @@ namespace mpi
             Index_t n;
             ::mpi::read( n, pos );
             ::mpi::read( pPcMessageData->mode(), pos );
+            ::mpi::read( pPcMessageData->layout(), pos );
             if constexpr(::mpi::_debug_ && _debug_) {
                 prdbg( concatenate( "MessageItem<ParticleContainer>::read(): n, mode"
                             , pPcMessageData->info()
                 ));
             }
 
+            std::vector<Id_t> ids;
+            index_coding::decode( pos, n, ids );
             if( pPcMessageData->mode() == set )
-            {// read the IDs of the particles to be overwritten
-                ::mpi::read( pPcMessageData->indices(), pos );
-             // todo: add ID to index translation
+            {// translate the IDs of the particles to be overwritten
+                pPcMessageData->indices() = ptr_pc_->indices(ids);
+                pPcMessageData->nMissing() = std::count( pPcMessageData->indices().begin(), pPcMessageData->indices().end(), Index_t(-1) );
+                if( pPcMessageData->nMissing() )
+                    trace::record(trace::particles, trace::info, trace::particles_missing, pPcMessageData->nMissing(), pPcMessageData->src());
                 if constexpr(::mpi::_debug_ && _debug_) {
                     prdbg( concatenate( "MessageItem<ParticleContainer>::read(): selection"
                                 , pPcMessageData->info()
@@ -190,11 +281,10 @@ namespace mpi
                 }
             } else
             {// mode == move|copy
-             // create n new particles
-                Indices_t & indices = pPcMessageData->indices();
-                indices.resize(n);
-                for( size_t i = 0; i < n; ++i )
-                    indices[i] = ptr_pc_->add();
+             // create n new particles, with the received IDs. Copies are ghosts, which are appended contiguously.
+                pPcMessageData->indices() = pPcMessageData->mode() == copy ? ptr_pc_->addGhosts(ids)
+                                                                           : ptr_pc_->addN(ids);
+                trace::record(trace::particles, trace::debug, trace::particles_added, n);
 
                 if constexpr(::mpi::_debug_ && _debug_) {
                     prdbg( concatenate( "MessageItem<ParticleContainer>::read(): particles added"
@@ -203,10 +293,91 @@ namespace mpi
                 }
             }
 
+            if( pPcMessageData->layout() == particle_major )
+            {// read the arrays
+                alignPos(pos);
+                readParticleMajor_(pos, pPcMessageData->indices());
+            }
+        }
+
+     // Locate the selection without reading it. The IDs are decoded into the view. In set mode
+     // pMessageData->indices() are the indices of the particles with these IDs, otherwise it is set to n times
+     // -1 (the particles do not exist in the receiving ParticleContainer).
+        virtual
+        void
+        view
+          ( void*& pos
+          , MessageData* pMessageData
+          , ItemView& itemView
+          ) const
+        {
+            PcMessageData* pPcMessageData = dynamic_cast<PcMessageData*>(pMessageData);
+            Index_t n;
+            ::mpi::read( n, pos );
+            ::mpi::read( pPcMessageData->mode(), pos );
+            ::mpi::read( pPcMessageData->layout(), pos );
+            std::vector<Id_t> ids;
+            index_coding::decode( pos, n, ids );
+            itemView.decoded.resize( n*sizeof(Id_t) );
+            if( n ) std::memcpy( itemView.decoded.data(), ids.data(), n*sizeof(Id_t) );
+            itemView.setInPlace<Id_t>( itemView.decoded.data(), n );
+            if( pPcMessageData->mode() == set )
+                pPcMessageData->indices() = ptr_pc_->indices(ids);
+            else
+                pPcMessageData->indices().assign( n, Index_t(-1) );
+            pPcMessageData->particleMajorData() = nullptr;
+            if( pPcMessageData->layout() == particle_major ) {
+                alignPos(pos);
+                pPcMessageData->particleMajorData() = (char const*)pos;
+                pos = (char*)pos + n*particleSize();
+            }
+        }
+
+     // The number of particles a received message will add to the ParticleContainer (0 in set mode), from the
+     // start of the message item, without reading it.
+        static size_t
+        nNewParticles(void const* pos)
+        {
+            size_t n;
+            Mode mode;
+            std::memcpy(&n, pos, sizeof(size_t));
+            std::memcpy(&mode, (char const*)pos + sizeof(size_t), sizeof(Mode));
+            return mode == set ? 0 : n;
+        }
+     // The mode of a received message, from the start of the message item, without reading it.
+        static Mode
+        peekMode(void const* pos)
+        {
+            Mode mode;
+            std::memcpy(&mode, (char const*)pos + sizeof(size_t), sizeof(Mode));
+            return mode;
+        }
+
+     // The number of bytes of a particle in particle_major layout.
+        size_t
+        particleSize() const
+        {
+            size_t nBytes = 0;
+            for( auto pArrayItem : arrayItems_ )
+                nBytes += pArrayItem->elementSize();
+            return nBytes;
+        }
+
+     // The offset of an array in a particle in particle_major layout.
+        size_t
+        offsetInParticle(ParticleArrayItemBase const* pArrayItem) const
+        {
+            size_t nBytes = 0;
+            for( auto p : arrayItems_ ) {
+                if( p == pArrayItem ) return nBytes;
+                nBytes += p->elementSize();
+            }
+            assert(false && "ParticleArray is not part of this ParticleContainer's messages.");
+            return 0;
         }
 
-     // The number of bytes that this MessageItem will occupy in a MessageBuffer. As this MessageItem only conveys
-     // the number of particles to be transferred, it is just sizeof()
+     // The number of bytes that this MessageItem will occupy in a MessageBuffer: the number of particles, the mode,
+     // the layout and the encoded IDs (and the arrays in particle_major layout).
         virtual size_t computeItemBufferSize
           ( MessageData const* pMessageData
           ) const
@@ -214,9 +385,11 @@ namespace mpi
             PcMessageData const* pPcMessageData = dynamic_cast<PcMessageData const*>(pMessageData);
 
             size_t nBytes = sizeof(size_t) // the size
-                          + sizeof(Mode);  // the mode
-            if( pPcMessageData->mode() == set ) {
-                nBytes += pPcMessageData->indices().size() * sizeof(Index_t);
+                          + sizeof(Mode)   // the mode
+                          + sizeof(Layout);// the layout
+            nBytes += index_coding::encodedSize( ptr_pc_->ids(pPcMessageData->indices()) );
+            if( effectiveLayout(pPcMessageData->mode()) == particle_major ) {
+                nBytes = padded(nBytes) + particleSize() * pPcMessageData->indices().size();
             }
             return nBytes;
         }
@@ -226,31 +399,128 @@ namespace mpi
         virtual INFO_DECL
         {
             std::stringstream ss;
-            ss<<indent<<"MessageItem<ParticleContainer>::info("<<title<<") : pc="<<ptr_pc_->name()<<", size="<<ptr_pc_->size();
+            ss<<indent<<"MessageItem<ParticleContainer>::info("<<title<<") : pc="<<ptr_pc_->name()<<", size="<<ptr_pc_->size()
+                      <<", layout="<<str(layout_)<<", arrays="<<arrayItems_.size();
             return ss.str();
         }
+
+    private:
+     // A plain array: its data and element size.
+        struct PlainArray_ {
+            char* data;
+            size_t size;
+        };
+
+        std::vector<PlainArray_>
+        plainArrays_() const
+        {
+            std::vector<PlainArray_> arrays;
+            for( auto pArrayItem : arrayItems_ )
+                arrays.push_back( {pArrayItem->arrayData(), pArrayItem->elementSize()} );
+            return arrays;
+        }
+
+     // Copy one element, with fixed size memcpy's for the common sizes.
+        static inline void
+        copyElement_(char* dst, char const* src, size_t size)
+        {
+            switch( size ) {
+                case  4: std::memcpy(dst, src,  4); break;
+                case  8: std::memcpy(dst, src,  8); break;
+                case 12: std::memcpy(dst, src, 12); break;
+                case 16: std::memcpy(dst, src, 16); break;
+                default: std::memcpy(dst, src, size);
+            }
+        }
+
+     // Write the elements of all arrays, particle by particle, in a single loop over the selection.
+        void
+        writeParticleMajor_(void*& pos, Indices_t const& indices) const
+        {
+            std::vector<PlainArray_> const arrays = plainArrays_();
+            char* d = (char*)pos;
+            for( auto index : indices ) {
+                for( auto const& a : arrays ) {
+                    copyElement_(d, a.data + index*a.size, a.size);
+                    d += a.size;
+                }
+            }
+            pos = d;
+        }
+
+     // Read the elements of all arrays, particle by particle, in a single loop over the selection.
+        void
+        readParticleMajor_(void*& pos, Indices_t const& indices)
+        {
+            std::vector<PlainArray_> const arrays = plainArrays_(); // after the particles were added
+            size_t const nBytes = particleSize();
+            char const* s = (char const*)pos;
+            for( auto index : indices ) {
+                if( index < 0 ) {// not on this rank (set mode)
+                    s += nBytes;
+                    continue;
+                }
+                for( auto const& a : arrays ) {
+                    copyElement_(a.data + index*a.size, s, a.size);
+                    s += a.size;
+                }
+            }
+            pos = (void*)s;
+        }
    };
+    namespace internal
+    {// true for a std::vector with any allocator
+        template<typename S>             struct is_std_vector                   : std::false_type {};
+        template<typename U, typename A> struct is_std_vector<std::vector<U,A>> : std::true_type {};
+    }
  //-------------------------------------------------------------------------------------------------
- // Specialisation
-    template <typename T>
-    class MessageItem<ParticleArray<T>> : public MessageItemBase
+ // Specialisation, for ParticleArrays with contiguous (std::vector, with any allocator) or paged storage.
+    template <typename T, typename Storage>
+    class MessageItem<ParticleArray<T, Storage>> : public ParticleArrayItemBase
  //-------------------------------------------------------------------------------------------------
     {
         static const bool _debug_ = true; // write debug output or not
 
     private: // data members
-        ParticleArray<T>* ptr_pa_;
+        ParticleArray<T, Storage>* ptr_pa_;
         MessageItem<ParticleContainer>* ptr_pc_message_item_;
+        PrecisionPolicy precision_;
+        using traits_ = internal::reduced_precision_able<T>;
+        using scalar_type_ = typename traits_::scalar_type;
+        mutable std::vector<scalar_type_> scratch_; // the components of the selected elements, for reduced precision
+        bool deltaEncoding_;
+        mutable std::vector<char> current_;                           // selected elements, for delta encoding
+        mutable std::map<int, std::vector<char>> sentSnapshots_;      // last values sent in set mode, per destination rank
+        std::map<int, std::vector<char>>         receivedSnapshots_;  // last values received in set mode, per source rank
+
+     // true if the elements are contiguous, as needed for particle_major layout
+        static constexpr bool isContiguous_ = internal::is_std_vector<Storage>::value;
+     // true if all elements occupy the same number of bytes in a message, false for e.g. std::vector<U>
+        static constexpr bool isFixedSize_ = internal::packed_memcpy_able<T>::value || internal::fixed_size_memcpy_able<T>::value;
+     // The number of bytes an element occupies in a message (0 if that is not fixed).
+        static constexpr size_t
+        fixedSize_() {
+            if constexpr(isFixedSize_) return fixedItemBufferSize<T>();
+            else return 0;
+        }
+
+     // The precision actually used in mode. Migrating particles are sent in full precision.
+        Precision effectivePrecision_(Mode mode) const {
+            return mode == move ? full_precision : precision_.precision;
+        }
 
     public:
      // ctor
         MessageItem
-          ( ParticleArray<T>& pa
+          ( ParticleArray<T, Storage>& pa
           , MessageItemBase* ptr_pc_message_item
           )
           : ptr_pa_(&pa)
           , ptr_pc_message_item_( dynamic_cast<MessageItem<ParticleContainer>*>(ptr_pc_message_item) )
-        {}
+          , deltaEncoding_(false)
+        {
+            ptr_pc_message_item_->addArrayItem(this);
+        }
 
      // dtor
         virtual
@@ -261,6 +531,51 @@ namespace mpi
             }
         }
 
+     // Set the precision with which the array is sent in copy and set mode (i.e. for ghost particles).
+     // In move mode the array is always sent in full precision.
+        void
+        setPrecision
+          ( PrecisionPolicy const& policy
+          )
+        {
+            assert( (policy.precision == full_precision || traits_::value)
+                 && "Reduced precision is only available for float or double scalars and vectors." );
+            assert( (policy.precision != fixed_point
+                 || (!policy.origin.empty() && !policy.extent.empty()))
+                 && "fixed_point precision needs an origin and an extent." );
+            precision_ = policy;
+        }
+        PrecisionPolicy const& precision() const { return precision_; }
+
+     // Send set mode messages (in full precision) delta encoded against the values sent previously to the
+     // same destination. Only the sender needs to enable this. The snapshots must be reset on both sides if
+     // the sender and the receiver may have lost track of each other (e.g. after a repartitioning).
+        void setDeltaEncoding(bool on = true) {
+            assert( (!on || isFixedSize_) && "Delta encoding is only available for fixed size types." );
+            deltaEncoding_ = on;
+        }
+        bool deltaEncoding() const { return deltaEncoding_; }
+        void resetSnapshots() {
+            sentSnapshots_.clear();
+            receivedSnapshots_.clear();
+        }
+
+     // ParticleArrayItemBase interface
+        virtual char*
+        arrayData() const {
+            if constexpr(isContiguous_) return (char*)ptr_pa_->data();
+            else return nullptr;
+        }
+        virtual size_t elementSize() const { return sizeof(T); }
+        virtual bool
+        isPlain(Mode mode) const
+        {
+            return isContiguous_
+                && internal::fixed_size_memcpy_able<T>::value && !internal::packed_memcpy_able<T>::value
+                && effectivePrecision_(mode) == full_precision
+                && !(mode == set && deltaEncoding_);
+        }
+
      // Write the selected array elements to the MessageBuffer
         virtual
         void
@@ -270,14 +585,56 @@ namespace mpi
           ) const
        {
             PcMessageData* pPcMessageData = dynamic_cast<PcMessageData*>(pMessageData);
+            if( pPcMessageData->layout() == particle_major )
+                return; // written by MessageItem<ParticleContainer>
 
             if constexpr(::mpi::_debug_ && _debug_) {
                 prdbg( concatenate("MessageItem<ParticleArray<T=", typeid(T).name(), ">>::write(ptr)")
                      , tolines(ptr_pa_->name(), *ptr_pa_, pPcMessageData->indices() )
                      );
             }
-            for( auto index : pPcMessageData->indices() )
-                ::mpi::write( (*ptr_pa_)[index], pos );
+            Precision precision = effectivePrecision_(pPcMessageData->mode());
+            ::mpi::write( precision, pos );
+
+            if constexpr(traits_::value) {
+                if( precision != full_precision )
+                {
+                    Indices_t const& indices = pPcMessageData->indices();
+                    int const N = traits_::nComponents;
+                    size_t const n = indices.size() * N;
+                 // gather the selected elements
+                    scratch_.resize(n);
+                    scalar_type_* s = scratch_.data();
+                    for( auto index : indices ) {
+                        scalar_type_ const* e = reinterpret_cast<scalar_type_ const*>(&(*ptr_pa_)[index]);
+                        for( int k = 0; k < N; ++k )
+                            *s++ = e[k];
+                    }
+                 // convert them
+                    if( precision == half_precision ) {
+                        alignPos(pos);
+                        internal::pack_half(scratch_.data(), n, pos);
+                    } else {
+                        scalar_type_ origin[N], extent[N];
+                        for( int k = 0; k < N; ++k ) {
+                            origin[k] = scalar_type_(precision_.origin_(k));
+                            extent[k] = scalar_type_(precision_.extent_(k));
+                            ::mpi::write( origin[k], pos );
+                            ::mpi::write( extent[k], pos );
+                        }
+                        alignPos(pos);
+                        internal::pack_fixed_point<N>(scratch_.data(), indices.size(), origin, extent, pos);
+                    }
+                    pos = (char*)pos + 2*n;
+                    return;
+                }
+            }
+            if( pPcMessageData->mode() == set ) {
+                writeDelta_(pos, pPcMessageData);
+                return;
+            }
+            alignPos(pos);
+            ::mpi::write_n( *ptr_pa_, pPcMessageData->indices(), pos );
         }
 
      // Read the selected particles from ptr
@@ -289,9 +646,54 @@ namespace mpi
           )
         {
             PcMessageData* pPcMessageData = dynamic_cast<PcMessageData*>(pMessageData);
-
-            for( auto index : pPcMessageData->indices() )
-                ::mpi::read( (*ptr_pa_)[index], pos );
+            if( pPcMessageData->layout() == particle_major )
+                return; // read by MessageItem<ParticleContainer>
+
+            Precision precision;
+            ::mpi::read( precision, pos );
+            if( precision == full_precision ) {
+                if( pPcMessageData->mode() == set )
+                    readDelta_(pos, pPcMessageData);
+                else {
+                    alignPos(pos);
+                    ::mpi::read_n( *ptr_pa_, pPcMessageData->indices(), pos );
+                }
+            } else {
+                if constexpr(traits_::value)
+                {
+                    Indices_t const& indices = pPcMessageData->indices();
+                    int const N = traits_::nComponents;
+                    size_t const n = indices.size() * N;
+                    scratch_.resize(n);
+                 // convert
+                    if( precision == half_precision ) {
+                        alignPos(pos);
+                        internal::unpack_half(pos, n, scratch_.data());
+                    } else {
+                        scalar_type_ origin[N], extent[N]; // as used by the sender
+                        for( int k = 0; k < N; ++k ) {
+                            ::mpi::read( origin[k], pos );
+                            ::mpi::read( extent[k], pos );
+                        }
+                        alignPos(pos);
+                        internal::unpack_fixed_point<N>(pos, indices.size(), origin, extent, scratch_.data());
+                    }
+                    pos = (char*)pos + 2*n;
+                 // scatter
+                    scalar_type_ const* s = scratch_.data();
+                    for( auto index : indices ) {
+                        if( index < 0 ) {// not on this rank (set mode)
+                            s += N;
+                            continue;
+                        }
+                        scalar_type_* e = reinterpret_cast<scalar_type_*>(&(*ptr_pa_)[index]);
+                        for( int k = 0; k < N; ++k )
+                            e[k] = *s++;
+                    }
+                } else {
+                    assert(false && "Reduced precision message for a ParticleArray that does not support it.");
+                }
+            }
 
             if constexpr(::mpi::_debug_ && _debug_) {
                 prdbg( concatenate("MessageItem<ParticleArray<T=", typeid(T).name(), ">>::read(ptr)")
@@ -300,14 +702,95 @@ namespace mpi
             }
         }
 
+     // Locate the selected array elements without reading them. The MessageItem<ParticleContainer> has been viewed.
+        virtual
+        void
+        view
+          ( void*& pos
+          , MessageData* pMessageData
+          , ItemView& itemView
+          ) const
+        {
+            PcMessageData* pPcMessageData = dynamic_cast<PcMessageData*>(pMessageData);
+            size_t const n = pPcMessageData->indices().size();
+            if( pPcMessageData->layout() == particle_major ) {
+                itemView.setInPlace<T>( pPcMessageData->particleMajorData() + ptr_pc_message_item_->offsetInParticle(this)
+                                      , n, ptr_pc_message_item_->particleSize() );
+                return;
+            }
+            Precision precision;
+            ::mpi::read( precision, pos );
+            if( precision != full_precision )
+            {// not available in place
+                if constexpr(traits_::value) {
+                    int const N = traits_::nComponents;
+                    if( precision == fixed_point )
+                        pos = (char*)pos + 2*N*sizeof(scalar_type_); // origin and extent
+                    alignPos(pos);
+                    pos = (char*)pos + 2*n*N;
+                }
+                itemView.size = n;
+                return;
+            }
+            if( pPcMessageData->mode() == set ) {
+                delta::Method method;
+                ::mpi::read( method, pos );
+                alignPos(pos);
+                if( method == delta::xor_ )
+                {// not available in place
+                    pos = (char*)pos + delta::encodedSize( pos, n*fixedSize_() );
+                    itemView.size = n;
+                    return;
+                }
+            } else
+                alignPos(pos);
+
+            if constexpr(internal::packed_memcpy_able<T>::value) {
+                pos = (char*)pos + n*internal::packed_size<T>();
+                itemView.size = n;
+            }
+            else if constexpr(internal::fixed_size_memcpy_able<T>::value) {
+                itemView.setInPlace<T>(pos, n);
+                pos = (char*)pos + n*sizeof(T);
+            }
+            else if constexpr(internal::variable_size_memcpy_able<T>::value)
+            {// the table of cumulative sizes, and the values of all elements
+                size_t nValues = 0;
+                if( n ) std::memcpy( &nValues, (char*)pos + (n - 1)*sizeof(size_t), sizeof(size_t) );
+                itemView.ends = (char const*)pos;
+                itemView.nEnds = n;
+                pos = (char*)pos + n*sizeof(size_t);
+                itemView.setInPlace<typename T::value_type>(pos, nValues);
+                pos = (char*)pos + nValues*sizeof(typename T::value_type);
+            }
+            else {
+                internal::skip_level<T>(n, pos);
+                itemView.size = n;
+            }
+        }
+
      // The number of bytes that this MessageItem will occupy in a MessageBuffer
         virtual size_t computeItemBufferSize
           ( MessageData const* pMessageData
           ) const
         {
             PcMessageData const* pPcMessageData = dynamic_cast<PcMessageData const*>(pMessageData);
-
-            return pPcMessageData->indices().size() * sizeof(T);
+            if( ptr_pc_message_item_->effectiveLayout(pPcMessageData->mode()) == particle_major )
+                return 0; // accounted for by MessageItem<ParticleContainer>
+
+            size_t nBytes = sizeof(Precision);
+            Precision precision = effectivePrecision_(pPcMessageData->mode());
+            if constexpr(traits_::value) {
+                if( precision != full_precision ) {
+                    int const N = traits_::nComponents;
+                    if( precision == fixed_point )
+                        nBytes += 2 * N * sizeof(scalar_type_); // origin and extent
+                    return padded(nBytes) + pPcMessageData->indices().size() * N * sizeof(uint16_t);
+                }
+            }
+            if( pPcMessageData->mode() == set )
+                nBytes += sizeof(delta::Method); // the delta encoded data are never larger than the raw data
+            return padded(nBytes) + ::mpi::computeBufferSize_n( *ptr_pa_, pPcMessageData->indices() );
         }
 
         virtual
@@ -315,9 +798,101 @@ namespace mpi
         {
             std::stringstream ss;
             ss<<indent<<"MessageItem<ParticleArray<"<<typeid(T).name()<<">>::info("<<title<<") : name="<<ptr_pa_->name()
-                      <<", pc="<<ptr_pc_message_item_->particleContainer().name();
+                      <<", pc="<<ptr_pc_message_item_->particleContainer().name()
+                      <<", precision="<<str(precision_.precision)
+                      <<", deltaEncoding="<<deltaEncoding_;
             return ss.str();
         }
+
+    private:
+     // Write the selected elements in set mode, delta encoded if that is enabled and pays off.
+        void
+        writeDelta_
+          ( void*& pos
+          , PcMessageData* pPcMessageData
+          ) const
+        {
+            delta::Method method = delta::plain;
+            if( !isFixedSize_ || !deltaEncoding_ ) {
+                ::mpi::write( method, pos );
+                alignPos(pos);
+                ::mpi::write_n( *ptr_pa_, pPcMessageData->indices(), pos );
+                return;
+            }
+         // gather the selected elements
+            size_t const nBytes = pPcMessageData->indices().size() * fixedSize_();
+            current_.resize(nBytes);
+            void* p = current_.data();
+            ::mpi::write_n( *ptr_pa_, pPcMessageData->indices(), p );
+
+            std::vector<char>& snapshot = sentSnapshots_[pPcMessageData->dst()];
+            void* methodPos = pos;
+            pos = (char*)pos + sizeof(delta::Method);
+            alignPos(pos);
+            char* data = (char*)pos;
+            size_t nEncoded = 0;
+            if( snapshot.size() == nBytes )
+                nEncoded = delta::encode(current_.data(), snapshot.data(), nBytes, data, nBytes);
+            if( nEncoded ) {
+                method = delta::xor_;
+            } else {
+                method = delta::snapshot;
+                std::memcpy(data, current_.data(), nBytes);
+                nEncoded = nBytes;
+            }
+            ::mpi::write( method, methodPos );
+            pos = (char*)pos + nEncoded;
+            snapshot.swap(current_);
+        }
+
+     // Read the selected elements in set mode.
+        void
+        readDelta_
+          ( void*& pos
+          , PcMessageData* pPcMessageData
+          )
+        {
+            delta::Method method;
+            ::mpi::read( method, pos );
+            alignPos(pos);
+            if( method == delta::plain ) {
+                readSelected_( pos, pPcMessageData );
+                return;
+            }
+            size_t const nBytes = pPcMessageData->indices().size() * fixedSize_();
+            std::vector<char>& snapshot = receivedSnapshots_[pPcMessageData->src()];
+            if( method == delta::snapshot ) {
+                snapshot.assign( (char*)pos, (char*)pos + nBytes );
+                pos = (char*)pos + nBytes;
+            } else {
+                assert( snapshot.size() == nBytes && "Delta encoded message does not match the snapshot." );
+                pos = (char*)pos + delta::decode(pos, snapshot.data(), nBytes, snapshot.data());
+            }
+         // scatter the selected elements
+            void* p = snapshot.data();
+            readSelected_( p, pPcMessageData );
+        }
+
+     // Read the selected elements with read_n. In set mode the selection may contain -1 for particles that are
+     // not on this rank: then all elements are read into a temporary array, and only the others are stored.
+        void
+        readSelected_
+          ( void*& pos
+          , PcMessageData const* pPcMessageData
+          )
+        {
+            Indices_t const& indices = pPcMessageData->indices();
+            if( !pPcMessageData->nMissing() ) {
+                ::mpi::read_n( *ptr_pa_, indices, pos );
+                return;
+            }
+            std::vector<T> received( indices.size() );
+            Indices_t all( indices.size() );
+            std::iota( all.begin(), all.end(), Index_t(0) );
+            ::mpi::read_n( received, all, pos );
+            for( size_t k = 0; k < indices.size(); ++k )
+                if( indices[k] >= 0 ) (*ptr_pa_)[indices[k]] = std::move(received[k]);
+        }
     };
 
  //-------------------------------------------------------------------------------------------------
@@ -327,16 +902,19 @@ namespace mpi
     private: // data members
         ParticleContainer& pc_;
         MessageItem<ParticleContainer>* ptr_pc_message_item_;
+        std::map<void const*, MessageItemBase*> arrayItems_; // the MessageItems of the ParticleArrays
         Index_t nParticles_;
     protected:
-     // ctor
-     // TODO: this ctor automatically adds the ParticleArrays to the MessageItemList.
-     // TODO: Add a way to selectively add/delete ParticleArrays and a suitable default.
-        PcMessageHandler(ParticleContainer& pc);
+     // ctor, adds the named ParticleArrays to the MessageItemList.
+        PcMessageHandler(ParticleContainer& pc, std::vector<std::string> const& arrayNames);
 
     public:
-     // Create and register a PcMessageHandler (through the proctected ctor)
+     // Create and register a PcMessageHandler (through the proctected ctor), for all ParticleArrays
+     // registered with pc at this point.
         static PcMessageHandler& create(ParticleContainer& pc);
+     // Idem, for a subset of the ParticleArrays, e.g. {"r"} for ghost updates. Only these arrays are
+     // packed in its messages.
+        static PcMessageHandler& create(ParticleContainer& pc, std::vector<std::string> const& arrayNames);
 
         virtual
         void
@@ -348,8 +926,62 @@ namespace mpi
 
         virtual
         void addRecvMessage(int src, size_t i);
+
+    protected:
+     // Grow the ParticleContainer once, for all particles that the received messages will add.
+        virtual void prepareRead_();
+
+    public:
+     // Add a ParticleArray to the messages.
+        template<typename T, typename Storage>
+        MessageItem<ParticleArray<T, Storage>>&
+        addParticleArray
+          ( ParticleArray<T, Storage>& pa
+          )
+        {
+            assert( arrayItems_.find(&pa) == arrayItems_.end() && "ParticleArray is already part of the message." );
+            MessageItem<ParticleArray<T, Storage>>* pItem = messageItemList().push_back(pa, ptr_pc_message_item_);
+            arrayItems_[&pa] = pItem;
+            return *pItem;
+        }
+
+     // Add a ParticleArray to the messages, by name.
+        void
+        addParticleArray
+          ( std::string const& name
+          );
+
+     // True if the ParticleArray is part of the messages.
+        bool hasParticleArray(ParticleArrayBase const& pa) const { return arrayItems_.count(&pa) > 0; }
+
+     // Select the layout of the messages (see MessageItem<ParticleContainer>::setLayout()).
+        void setLayout(Layout layout) { ptr_pc_message_item_->setLayout(layout); }
+
+     // The MessageItem of a ParticleArray, e.g. to set its precision.
+        template<typename T, typename Storage>
+        MessageItem<ParticleArray<T, Storage>>&
+        messageItem
+          ( ParticleArray<T, Storage> const& pa
+          )
+        {
+            auto it = arrayItems_.find(&pa);
+            assert( it != arrayItems_.end() && "ParticleArray is not part of the message." );
+            return *dynamic_cast<MessageItem<ParticleArray<T, Storage>>*>(it->second);
+        }
     };
 
  //-------------------------------------------------------------------------------------------------
 }// namespace mpi
+
+namespace mpacts
+{//-------------------------------------------------------------------------------------------------
+    template<typename T, typename Storage>
+    void
+    ParticleArray<T, Storage>::
+    addToMessages(mpi::PcMessageHandler& hndlr)
+    {
+        hndlr.addParticleArray(*this);
+    }
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpacts
 #endif // MPI_PARTICLECONTAINER_H
\ No newline at end of file
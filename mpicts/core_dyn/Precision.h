@@ -0,0 +1,255 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include "mpicts.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <Eigen/Geometry>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+ // Reduced precision for ParticleArrays of ghost particles.
+ // Ghost particles are only used for computing interactions with neighbours, and often do not need
+ // full precision. A ParticleArray can be sent with
+ //   - full_precision : as is,
+ //   - half_precision : as IEEE 754 half precision floats (16 bit), relative error < 2^-11,
+ //   - fixed_point    : as 16 bit fixed point numbers in the interval [origin, origin + extent[,
+ //                      absolute error < extent/2^17 (plus the rounding error of the scalar type).
+ //                      Values outside the interval are clamped. The values are quantized in their own
+ //                      scalar type, relative to the origin, which is sent in that type too.
+ // Reduced precision applies only to ParticleArrays of float or double scalars or (Eigen) vectors
+ // thereof.
+ // The conversion kernels are plain loops over contiguous data, which the compiler vectorizes. The
+ // F16C instructions for half precision are only used if they are enabled at compile time (e.g.
+ // with MPICTS_NATIVE), otherwise half precision is converted with scalar code.
+ //-------------------------------------------------------------------------------------------------
+    enum Precision : uint8_t
+    { full_precision = 0
+    , half_precision = 1
+    , fixed_point    = 2
+    };
+
+    std::string
+    str( Precision precision )
+    {
+        switch(precision) {
+            case full_precision: return "full_precision";
+            case half_precision: return "half_precision";
+            case fixed_point   : return "fixed_point";
+            default:
+                assert(false && "Unknwown precision");
+        }
+    }
+
+ //-------------------------------------------------------------------------------------------------
+    struct PrecisionPolicy
+ //-------------------------------------------------------------------------------------------------
+    {
+        Precision precision = full_precision;
+     // for fixed_point: the interval per component, if there is only one value it applies to all components.
+        std::vector<double> origin = {0.0};
+        std::vector<double> extent = {1.0};
+
+        double origin_(size_t k) const { return origin[k % origin.size()]; }
+        double extent_(size_t k) const { return extent[k % extent.size()]; }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+    namespace internal
+    {//-------------------------------------------------------------------------------------------------
+     // The scalar type and number of components of types that can be sent in reduced precision.
+        template<typename T>
+        struct reduced_precision_able : std::false_type {
+            using scalar_type = float; // (unused)
+            static constexpr int nComponents = 1;
+        };
+
+        template<>
+        struct reduced_precision_able<float> : std::true_type {
+            using scalar_type = float;
+            static constexpr int nComponents = 1;
+        };
+
+        template<>
+        struct reduced_precision_able<double> : std::true_type {
+            using scalar_type = double;
+            static constexpr int nComponents = 1;
+        };
+
+        template<typename S, int N>
+        struct reduced_precision_able<Eigen::Matrix<S,N,1,Eigen::DontAlign>> : reduced_precision_able<S> {
+            static constexpr int nComponents = N;
+        };
+
+     //-------------------------------------------------------------------------------------------------
+     // Scalar conversions between float and IEEE 754 half precision (round to nearest even).
+        inline uint16_t
+        float_to_half(float f)
+        {
+            uint32_t x;
+            memcpy(&x, &f, 4);
+            uint32_t sign = (x >> 16) & 0x8000;
+            uint32_t mant = x & 0x7fffff;
+            int32_t  exp  = int32_t((x >> 23) & 0xff) - 127 + 15;
+            if( ((x >> 23) & 0xff) == 0xff ) // inf or nan
+                return uint16_t( sign | 0x7c00 | (mant ? 0x200 : 0) );
+            if( exp >= 31 ) // overflow
+                return uint16_t( sign | 0x7c00 );
+            if( exp <= 0 )
+            {// subnormal
+                if( exp < -10 ) return uint16_t(sign);
+                mant |= 0x800000;
+                uint32_t shift = 14 - exp;
+                uint32_t h = mant >> shift;
+                uint32_t rem = mant & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if( rem > halfway || (rem == halfway && (h & 1)) ) ++h;
+                return uint16_t(sign | h);
+            }
+            uint32_t h = (uint32_t(exp) << 10) | (mant >> 13);
+            uint32_t rem = mant & 0x1fff;
+            if( rem > 0x1000 || (rem == 0x1000 && (h & 1)) ) ++h; // may carry into the exponent, which is correct.
+            return uint16_t(sign | h);
+        }
+
+        inline float
+        half_to_float(uint16_t h)
+        {
+            uint32_t sign = uint32_t(h & 0x8000) << 16;
+            uint32_t exp  = (h >> 10) & 0x1f;
+            uint32_t mant = h & 0x3ff;
+            uint32_t x;
+            if( exp == 0 ) {
+                if( mant == 0 )
+                    x = sign;
+                else {// subnormal, normalize
+                    exp = 127 - 15 + 1;
+                    while( !(mant & 0x400) ) { mant <<= 1; --exp; }
+                    x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+                }
+            }
+            else if( exp == 31 )
+                x = sign | 0x7f800000 | (mant << 13);
+            else
+                x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+            float f;
+            memcpy(&f, &x, 4);
+            return f;
+        }
+
+     //-------------------------------------------------------------------------------------------------
+     // Conversion kernels. The 16 bit side is a message buffer position, which need not be aligned.
+     // Convert n floats to half precision.
+        inline void
+        pack_half(float const* src, size_t n, void* dst)
+        {
+            char* d = (char*)dst;
+            size_t i = 0;
+#if defined(__F16C__)
+            for( ; i + 8 <= n; i += 8 ) {
+                __m128i h = _mm256_cvtps_ph( _mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT );
+                _mm_storeu_si128( (__m128i*)(d + 2*i), h );
+            }
+#endif
+            for( ; i < n; ++i ) {
+                uint16_t h = float_to_half(src[i]);
+                memcpy(d + 2*i, &h, 2);
+            }
+        }
+
+     // Convert n half precision numbers to float.
+        inline void
+        unpack_half(void const* src, size_t n, float* dst)
+        {
+            char const* s = (char const*)src;
+            size_t i = 0;
+#if defined(__F16C__)
+            for( ; i + 8 <= n; i += 8 ) {
+                __m128i h = _mm_loadu_si128( (__m128i const*)(s + 2*i) );
+                _mm256_storeu_ps( dst + i, _mm256_cvtph_ps(h) );
+            }
+#endif
+            for( ; i < n; ++i ) {
+                uint16_t h;
+                memcpy(&h, s + 2*i, 2);
+                dst[i] = half_to_float(h);
+            }
+        }
+
+     // Convert n doubles to half precision (through float, which loses nothing that half precision keeps).
+        inline void
+        pack_half(double const* src, size_t n, void* dst)
+        {
+            float f[64];
+            for( size_t i = 0; i < n; i += 64 ) {
+                size_t const m = std::min<size_t>(64, n - i);
+                for( size_t j = 0; j < m; ++j ) f[j] = float(src[i + j]);
+                pack_half(f, m, (char*)dst + 2*i);
+            }
+        }
+
+     // Convert n half precision numbers to double.
+        inline void
+        unpack_half(void const* src, size_t n, double* dst)
+        {
+            float f[64];
+            for( size_t i = 0; i < n; i += 64 ) {
+                size_t const m = std::min<size_t>(64, n - i);
+                unpack_half((char const*)src + 2*i, m, f);
+                for( size_t j = 0; j < m; ++j ) dst[i + j] = f[j];
+            }
+        }
+
+     // Quantize n elements of N components (scalars of type S, interleaved) to 16 bit fixed point numbers,
+     // component k in [origin[k], origin[k] + extent[k][.
+        template<int N, typename S>
+        inline void
+        pack_fixed_point(S const* src, size_t n, S const* origin, S const* extent, void* dst)
+        {
+            S o[N], scale[N];
+            for( int k = 0; k < N; ++k ) {
+                o[k] = origin[k];
+                scale[k] = S(65536) / extent[k];
+            }
+            char* d = (char*)dst;
+            for( size_t i = 0; i < n; ++i )
+                for( int k = 0; k < N; ++k ) {
+                    S v = (src[i*N + k] - o[k]) * scale[k];
+                    v = std::min( std::max(v, S(0)), S(65535) );
+                    uint16_t q = uint16_t(int32_t(v));
+                    memcpy(d + 2*(i*N + k), &q, 2);
+                }
+        }
+
+     // Inverse of pack_fixed_point. Values are restored to the centre of their quantization interval.
+        template<int N, typename S>
+        inline void
+        unpack_fixed_point(void const* src, size_t n, S const* origin, S const* extent, S* dst)
+        {
+            S o[N], scale[N];
+            for( int k = 0; k < N; ++k ) {
+                o[k] = origin[k];
+                scale[k] = extent[k] / S(65536);
+            }
+            char const* s = (char const*)src;
+            for( size_t i = 0; i < n; ++i )
+                for( int k = 0; k < N; ++k ) {
+                    uint16_t q;
+                    memcpy(&q, s + 2*(i*N + k), 2);
+                    dst[i*N + k] = o[k] + (S(q) + S(0.5)) * scale[k];
+                }
+        }
+
+     //-------------------------------------------------------------------------------------------------
+    }// namespace internal
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // PRECISION_H
@@ -0,0 +1,152 @@
+#ifndef SPACEFILLINGCURVE_H
+#define SPACEFILLINGCURVE_H
+
+#include "mpicts.h"
+
+#include <algorithm>
+#include <cassert>
+#if defined(__BMI2__)
+#  include <immintrin.h>
+#endif
+
+namespace mpi
+{
+namespace sfc
+{//-------------------------------------------------------------------------------------------------
+ // Space filling curve keys of 3D points, for ordering particles so that particles that are close
+ // in space are close in memory:
+ //   - morton : interleaves the bits of the coordinates (z-order), cheap,
+ //   - hilbert: the Hilbert curve (Skilling 2004), successive cells are always adjacent, so the
+ //              particles in a box form fewer runs.
+ // Coordinates are quantized to 21 bits per dimension, so that a key fits in 64 bits.
+ //-------------------------------------------------------------------------------------------------
+    enum Curve : uint8_t
+    { morton  = 0
+    , hilbert = 1
+    };
+
+    inline std::string
+    str( Curve curve )
+    {
+        switch(curve) {
+            case morton : return "morton";
+            case hilbert: return "hilbert";
+            default:
+                assert(false && "Unknwown curve");
+        }
+        return "";
+    }
+
+    int const nBits = 21; // bits per dimension
+
+ // Quantize v in [lo, hi] to [0, 2^bits[.
+    inline uint32_t
+    quantize(float v, float lo, float hi, int bits = nBits)
+    {
+        float const scale = float((1u << bits) - 1)/(hi - lo);
+        float q = (v - lo)*scale;
+        return q <= 0 ? 0 : q >= float((1u << bits) - 1) ? (1u << bits) - 1 : uint32_t(q);
+    }
+
+ // Spread the 21 low bits of v to every third bit.
+    inline uint64_t
+    spread3(uint64_t v)
+    {
+#if defined(__BMI2__)
+        return _pdep_u64(v, 0x1249249249249249ull);
+#else
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v <<  8) & 0x100f00f00f00f00full;
+        v = (v | v <<  4) & 0x10c30c30c30c30c3ull;
+        v = (v | v <<  2) & 0x1249249249249249ull;
+        return v;
+#endif
+    }
+
+ // The Morton key of the cell (x, y, z), x varies slowest.
+    inline uint64_t
+    mortonKey(uint32_t x, uint32_t y, uint32_t z)
+    {
+        return spread3(x) << 2 | spread3(y) << 1 | spread3(z);
+    }
+
+ // The Hilbert key of the cell (x, y, z) in a grid of 2^bits cells per dimension: the coordinates are
+ // transformed into the transposed Hilbert index (Skilling's AxesToTranspose), whose bits are then
+ // interleaved like a Morton key.
+    inline uint64_t
+    hilbertKey(uint32_t x, uint32_t y, uint32_t z, int bits = nBits)
+    {
+        uint32_t X[3] = {x, y, z};
+        uint32_t const M = 1u << (bits - 1);
+        for( uint32_t Q = M; Q > 1; Q >>= 1 ) {// inverse undo
+            uint32_t const P = Q - 1;
+            for( int i = 0; i < 3; ++i ) {
+                if( X[i] & Q ) X[0] ^= P;
+                else {
+                    uint32_t t = (X[0] ^ X[i]) & P;
+                    X[0] ^= t;
+                    X[i] ^= t;
+                }
+            }
+        }
+        X[1] ^= X[0];// Gray encode
+        X[2] ^= X[1];
+        uint32_t t = 0;
+        for( uint32_t Q = M; Q > 1; Q >>= 1 )
+            if( X[2] & Q ) t ^= Q - 1;
+        for( int i = 0; i < 3; ++i ) X[i] ^= t;
+        return mortonKey(X[0], X[1], X[2]);
+    }
+
+    inline uint64_t
+    key(Curve curve, uint32_t x, uint32_t y, uint32_t z)
+    {
+        return curve == morton ? mortonKey(x, y, z) : hilbertKey(x, y, z);
+    }
+
+ //-------------------------------------------------------------------------------------------------
+ // Sort keys and values by key: a stable LSD radix sort with 8 bit digits. The histograms of all
+ // digits are computed in a single pass, and passes in which all keys have the same digit are
+ // skipped, so small keys need few passes.
+    template<typename V>
+    void
+    radixSort
+      ( std::vector<uint64_t>& keys
+      , std::vector<V>& values
+      )
+    {
+        size_t const n = keys.size();
+        assert( values.size() == n && "Keys and values must have the same size." );
+        std::vector<size_t> count(8*256, 0);
+        for( auto k : keys )
+            for( int d = 0; d < 8; ++d )
+                ++count[256*d + ((k >> 8*d) & 0xff)];
+        std::vector<uint64_t> keys2(n);
+        std::vector<V> values2(n);
+        for( int d = 0; d < 8; ++d )
+        {
+            size_t* c = &count[256*d];
+            if( n == 0 || *std::max_element(c, c + 256) == n ) continue; // all keys have the same digit
+            size_t offset = 0;
+            for( int b = 0; b < 256; ++b ) {
+                size_t cb = c[b];
+                c[b] = offset;
+                offset += cb;
+            }
+            for( size_t i = 0; i < n; ++i ) {
+                size_t j = c[(keys[i] >> 8*d) & 0xff]++;
+                keys2[j] = keys[i];
+                values2[j] = values[i];
+            }
+            keys.swap(keys2);
+            values.swap(values2);
+        }
+    }
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace sfc
+}// namespace mpi
+
+#endif // SPACEFILLINGCURVE_H
@@ -0,0 +1,141 @@
+#ifndef STATICMESSAGE_H
+#define STATICMESSAGE_H
+
+#include "memcpy_able.h"
+#include "MessageHandler.h"
+
+#include <tuple>
+
+namespace mpi
+{//-------------------------------------------------------------------------------------------------
+    template <typename... Ts>
+    class StaticMessage
+ // Compile time alternative for MessageItemList.
+ // The message is composed of references to objects of types Ts..., which are kept in a std::tuple.
+ // There is no heap allocation per item and no virtual call per item: write, read and size
+ // computation are unrolled at compile time. If all Ts are fixed_size_memcpy_able or
+ // packed_memcpy_able, the size of the message is a compile time constant.
+ // Ts must be memcpy-able types, i.e. the types that MessageItem<T> accepts. (ParticleContainers
+ // and ParticleArrays need a PcMessageHandler.)
+ //-------------------------------------------------------------------------------------------------
+    {
+        std::tuple<Ts&...> items_;
+
+    public:
+     // true if the message size is a compile time constant.
+        static constexpr bool is_fixed_size = ( ( internal::packed_memcpy_able    <Ts>::value
+                                               || internal::fixed_size_memcpy_able<Ts>::value ) && ... );
+
+     // The size (bytes) of a fixed size message, 0 otherwise.
+        static constexpr size_t fixed_size_()
+        {
+            if constexpr(is_fixed_size)
+                return ( fixedItemBufferSize<Ts>() + ... + size_t(0) );
+            else
+                return 0;
+        }
+        static constexpr size_t fixed_size = fixed_size_();
+
+     // ctor
+        StaticMessage
+          ( Ts&... ts // objects to incorporate in the message
+          )
+          : items_(ts...)
+        {}
+
+        static constexpr size_t size() { return sizeof...(Ts); }
+
+     // Write the message to the buffer of pMessageData. Returns the number of bytes written.
+        size_t
+        write
+          ( MessageData* pMessageData
+          ) const
+        {
+            void* pos = pMessageData->bufferPtr();
+            std::apply( [&pos](Ts&... ts) { ( ::mpi::write(ts, pos), ... ); }, items_ );
+            return (char*)pos - (char*)pMessageData->bufferPtr();
+        }
+
+     // Read the message from the buffer of pMessageData.
+        void
+        read
+          ( MessageData* pMessageData
+          )
+        {
+            void* pos = pMessageData->bufferPtr();
+            std::apply( [&pos](Ts&... ts) { ( ::mpi::read(ts, pos), ... ); }, items_ );
+        }
+
+     // Compute the number of bytes the message occupies in a MessageBuffer, and store it in the
+     // MessageHeader of pMessageData.
+        size_t
+        computeMessageBufferSize
+          ( MessageData* pMessageData
+          ) const
+        {
+            size_t sz;
+            if constexpr(is_fixed_size)
+                sz = fixed_size;
+            else
+                sz = std::apply( [](Ts&... ts) { return ( ::mpi::computeItemBufferSize(ts) + ... + size_t(0) ); }, items_ );
+            pMessageData->size() = sz;
+            return sz;
+        }
+
+        INFO_DECL
+        {
+            std::stringstream ss;
+            ss<<indent<<"StaticMessage.info("<<title<<") : ( size="<<size();
+            if constexpr(is_fixed_size)
+                ss<<", fixed_size="<<fixed_size;
+            ss<<" )";
+            ( (ss<<indent<<"  T="<<typeid(Ts).name()), ... );
+            return ss.str();
+        }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+    template <typename... Ts>
+    class StaticMessageHandler : public MessageHandler
+ // A MessageHandler that composes its messages with a StaticMessage<Ts...> rather than with its
+ // MessageItemList (which remains empty). It plugs into the normal send/receive flow:
+ //     auto& hndlr = StaticMessageHandler<double,std::vector<int>>::create(a, ints);
+ //     hndlr.addSendMessage(dst);
+ //     MessageHeader::broadcastMessageHeaders();
+ //     hndlr.sendMessages();
+ //     hndlr.recvMessages();
+ //-------------------------------------------------------------------------------------------------
+    {
+        mutable StaticMessage<Ts...> staticMessage_;
+
+    protected:
+        StaticMessageHandler(Ts&... ts)
+          : staticMessage_(ts...)
+        {}
+
+    public:
+     // Create and register a StaticMessageHandler (through the protected ctor)
+        static StaticMessageHandler& create(Ts&... ts)
+        {
+            StaticMessageHandler* pStaticMessageHandler = new StaticMessageHandler(ts...);
+            return *pStaticMessageHandler;
+        }
+
+        inline StaticMessage<Ts...> const& staticMessage() const { return staticMessage_; }
+
+    protected:
+        virtual size_t computeMessageBufferSize_(MessageData* pMessageData) const {
+            return staticMessage_.computeMessageBufferSize(pMessageData);
+        }
+        virtual size_t writeMessage_(MessageData* pMessageData) const {
+            return staticMessage_.write(pMessageData);
+        }
+        virtual void readMessage_(MessageData* pMessageData) {
+            staticMessage_.read(pMessageData);
+        }
+    };
+
+ //-------------------------------------------------------------------------------------------------
+}// namespace mpi
+
+#endif // STATICMESSAGE_H
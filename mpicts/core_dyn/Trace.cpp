@@ -0,0 +1,167 @@
+#include "Trace.h"
+#include "mpicts.h"
+
+#include <cstring>
+
+namespace mpi
+{
+namespace trace
+{//---------------------------------------------------------------------------------------------------------------------
+ // Implementation of class Tracer
+ //---------------------------------------------------------------------------------------------------------------------
+    Tracer theTracer;
+
+    Tracer::
+    Tracer()
+      : level_(off)
+      , mask_(all)
+      , ringMask_(0)
+      , head_(0)
+      , tail_(0)
+      , nDropped_(0)
+      , file_(nullptr)
+      , stop_(false)
+    {
+        updateEnabled_();
+    }
+
+    Tracer::
+    ~Tracer()
+    {
+        stop();
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    Tracer::
+    start(std::string const& fname, size_t nRecords)
+    {
+        stop();
+
+        size_t capacity = 2;
+        while( capacity < nRecords ) capacity *= 2;
+        ring_.resize(capacity);
+        ringMask_ = capacity - 1;
+        head_ = 0;
+        tail_ = 0;
+        nDropped_ = 0;
+
+        fname_ = fname;
+        file_ = fopen(fname.c_str(), "wb");
+        if( file_ == nullptr ) {
+            printf("Tracer failed to open %s file: permission issue?\n", fname.c_str());
+            return;
+        }
+
+        using namespace std::chrono;
+        t0_ = steady_clock::now();
+        FileHeader fileHeader;
+        std::memcpy(fileHeader.magic, "MPICTRC1", 8);
+        fileHeader.rank = mpi::rank;
+        fileHeader.size = mpi::size;
+        fileHeader.recordSize = sizeof(Record);
+        fileHeader.epoch = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        fwrite(&fileHeader, sizeof(FileHeader), 1, file_);
+
+        stop_ = false;
+        flusher_ = std::thread(&Tracer::flusherLoop_, this);
+        updateEnabled_();
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    Tracer::
+    stop()
+    {
+        if( !isStarted() ) return;
+        for( auto& mask : enabled_ ) mask = 0; // no more records
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        flusher_.join();
+
+        writeRecords_(); // records written after the flusher's last round
+        fclose(file_);
+        file_ = nullptr;
+        updateEnabled_();
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    Tracer::
+    updateEnabled_()
+    {
+        for( int level = off; level <= verbose; ++level ) {
+            enabled_[level] = ( isStarted() && level != off && level <= level_ ) ? mask_ : 0;
+        }
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    Tracer::
+    flush()
+    {
+        if( !isStarted() ) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        writeRecords_();
+        fflush(file_);
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    Tracer::
+    flusherLoop_()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while( !stop_ )
+        {
+            cv_.wait_for(lock, std::chrono::milliseconds(10));
+            writeRecords_();
+        }
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // Must be called with mutex_ locked (or after the flusher thread has been joined).
+    void
+    Tracer::
+    writeRecords_()
+    {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        while( tail < head )
+        {// write the records in [tail,head[, in at most two contiguous chunks
+            uint64_t begin = tail & ringMask_;
+            uint64_t n = std::min<uint64_t>(head - tail, ring_.size() - begin);
+            fwrite(&ring_[begin], sizeof(Record), n, file_);
+            tail += n;
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    std::vector<Record>
+    readTraceFile(std::string const& fname, FileHeader* pFileHeader)
+    {
+        std::vector<Record> records;
+        FILE* fh = fopen(fname.c_str(), "rb");
+        if( fh == nullptr ) return records;
+
+        FileHeader fileHeader;
+        if( fread(&fileHeader, sizeof(FileHeader), 1, fh) == 1
+         && std::strncmp(fileHeader.magic, "MPICTRC1", 8) == 0
+         && fileHeader.recordSize == sizeof(Record)
+          ) {
+            if( pFileHeader ) *pFileHeader = fileHeader;
+            Record r;
+            while( fread(&r, sizeof(Record), 1, fh) == 1 )
+                records.push_back(r);
+        }
+        fclose(fh);
+        return records;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+}// namespace trace
+}// namespace mpi
@@ -0,0 +1,210 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mpi
+{
+namespace trace
+{//---------------------------------------------------------------------------------------------------------------------
+ // Low overhead tracing.
+ // Trace records are small fixed size binary structs, which are stored in a preallocated ring buffer. A background
+ // thread flushes the ring buffer to a binary file `_<rank>.trc`. Which records are stored is controlled at runtime
+ // by a level and a mask of categories, so that tracing can remain switched on in production: a disabled trace
+ // point costs a load, a test and a branch, an enabled trace point a timestamp and a 32 byte store.
+ // (For human readable debug output, see prdbg() in mpicts.h. That is switched on at compile time with mpi::_debug_.)
+ //
+ // Usage:
+ //     trace::theTracer.setLevel(trace::verbose);
+ //     trace::theTracer.setMask(trace::message | trace::memcpy);
+ //     ...
+ //     trace::record(trace::message, trace::info, trace::message_sent, nBytes, dst);
+ //
+ // Tracing is off by default. The tracer is started by mpi::init() if the level is not off, and stopped by
+ // mpi::finalize(). The initial level and mask can be set with the environment variables MPICTS_TRACE_LEVEL (0-4,
+ // default 0) and MPICTS_TRACE_MASK (default 0xffffffff), the directory of the trace files with MPICTS_TRACE_DIR
+ // (default: the current directory).
+ //---------------------------------------------------------------------------------------------------------------------
+    enum Level : uint8_t
+    { off     = 0
+    , error   = 1
+    , info    = 2 // one record per message or per collective operation
+    , debug   = 3 // one record per MessageItem
+    , verbose = 4 // one record per memcpy
+    };
+
+    enum Category : uint32_t
+    { general   = 1 << 0
+    , header    = 1 << 1 // MessageHeaders
+    , message   = 1 << 2 // sending and receiving messages
+    , item      = 1 << 3 // MessageItems
+    , memcpy    = 1 << 4 // memcpy_traits
+    , particles = 1 << 5 // ParticleContainers
+    , memory    = 1 << 6 // allocations with a MemoryPolicy
+    , all       = 0xffffffff
+    };
+
+    enum Event : uint16_t
+    { init                // a = mpi::rank, b = mpi::size
+    , finalize            // a = number of dropped records
+    , headers_broadcast   // a = number of MessageHeaders of this rank
+    , message_written     // a = message size (bytes), b = MessageHandler key
+    , message_compressed  // a = message size (bytes), b = frame size (bytes)
+    , message_sent        // a = message size (bytes), b = destination rank
+    , message_received    // a = message size (bytes), b = source rank
+    , message_read        // a = message size (bytes), b = MessageHandler key
+    , item_written        // a = number of bytes written
+    , item_read           // a = number of bytes read
+    , memcpy_write        // a = number of bytes written, b = destination pointer
+    , memcpy_read         // a = number of bytes read, b = source pointer
+    , particles_added     // a = number of particles added
+    , particles_removed   // a = number of particles removed
+    , particles_reserved  // a = number of particles announced by the received messages, b = capacity
+    , memory_allocated    // a = number of bytes, b = NUMA node the memory is bound to (-1: not bound). Level error: mbind failed
+    , particles_missing   // a = number of IDs in a set message that are not on this rank, b = source rank
+    , user = 1000         // first Event id available for user code
+    };
+
+ //---------------------------------------------------------------------------------------------------------------------
+    struct Record
+ // A trace record, as it is stored in the ring buffer and in the trace file.
+ //---------------------------------------------------------------------------------------------------------------------
+    {
+        int64_t  time;     // nanoseconds since the tracer was started
+        uint32_t category; // Category
+        uint16_t event;    // Event
+        uint8_t  level;    // Level
+        uint8_t  unused;
+        uint64_t a;        // event specific
+        uint64_t b;        // event specific
+    };
+    static_assert( sizeof(Record) == 32 );
+
+ //---------------------------------------------------------------------------------------------------------------------
+    struct FileHeader
+ // The header of a trace file. It is followed by the Records.
+ //---------------------------------------------------------------------------------------------------------------------
+    {
+        char     magic[8];    // "MPICTRC1"
+        int32_t  rank;
+        int32_t  size;
+        uint64_t recordSize;  // sizeof(Record)
+        int64_t  epoch;       // start time of the tracer, nanoseconds since the epoch of std::chrono::system_clock
+    };
+
+ //---------------------------------------------------------------------------------------------------------------------
+    class Tracer
+ // Single producer ring buffer of Records, flushed to a file by a background thread. Only the thread that started
+ // the Tracer may write records.
+ // If the ring buffer is full, records are dropped (and counted) rather than blocking the producer.
+ //---------------------------------------------------------------------------------------------------------------------
+    {
+        Level    level_;
+        uint32_t mask_;
+        uint32_t enabled_[5]; // enabled_[level] = the mask of enabled categories for level (0 if not started)
+
+        std::vector<Record> ring_;  // capacity is a power of 2
+        uint64_t ringMask_;         // ring_.size() - 1
+        std::atomic<uint64_t> head_; // number of records written by the producer
+        std::atomic<uint64_t> tail_; // number of records flushed by the flusher
+        uint64_t nDropped_;
+
+        std::chrono::steady_clock::time_point t0_;
+
+        FILE* file_;
+        std::string fname_;
+        std::thread flusher_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        bool stop_;
+
+    public:
+        Tracer();
+        ~Tracer();
+
+     // Start tracing to file fname. The ring buffer holds nRecords records (rounded up to a power of 2).
+        void start(std::string const& fname, size_t nRecords = 1<<16);
+     // Flush all records to the file and stop the flusher thread.
+        void stop();
+     // Make sure that all records written so far are in the trace file.
+        void flush();
+
+        inline bool isStarted() const { return file_ != nullptr; }
+     // The name of the current (or last) trace file.
+        inline std::string const& fname() const { return fname_; }
+
+        inline void setLevel(Level level) { level_ = level; updateEnabled_(); }
+        inline Level level() const { return level_; }
+        inline void setMask(uint32_t mask) { mask_ = mask; updateEnabled_(); }
+        inline uint32_t mask() const { return mask_; }
+        inline uint64_t nDropped() const { return nDropped_; }
+
+     // Test if a category is enabled at a level. This is a single load and test.
+        inline bool
+        enabled(uint32_t category, Level level) const {
+            return enabled_[level] & category;
+        }
+
+     // Store a record in the ring buffer. (Not checking if it is enabled, the tracer must be started)
+        inline void
+        record(uint32_t category, Level level, uint16_t event, uint64_t a, uint64_t b)
+        {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            if( head - tail_.load(std::memory_order_acquire) > ringMask_ ) {
+                ++nDropped_;
+                return;
+            }
+            Record& r = ring_[head & ringMask_];
+            r.time     = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0_).count();
+            r.category = category;
+            r.event    = event;
+            r.level    = level;
+            r.a        = a;
+            r.b        = b;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+    private:
+        void updateEnabled_();
+        void flusherLoop_();
+        void writeRecords_(); // write the records between tail_ and head_ to the file
+    };
+
+    extern Tracer theTracer;
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // A trace point. Stores a record if the category and level are enabled.
+    inline void
+    record
+      ( uint32_t category // Category
+      , Level level       //
+      , uint16_t event    // Event
+      , uint64_t a = 0    // event specific data
+      , uint64_t b = 0    // event specific data
+      )
+    {
+        if( theTracer.enabled(category, level) )
+            theTracer.record(category, level, event, a, b);
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // Read a trace file (for post-processing and testing).
+    std::vector<Record>
+    readTraceFile
+      ( std::string const& fname
+      , FileHeader* pFileHeader = nullptr // if not nullptr, the file header is copied here.
+      );
+
+ //---------------------------------------------------------------------------------------------------------------------
+}// namespace trace
+}// namespace mpi
+
+#endif // TRACE_H
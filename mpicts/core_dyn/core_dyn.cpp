@@ -8,17 +8,28 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
 
+#include <map>
+#include <unordered_map>
+#include <unistd.h>
+
 namespace py = pybind11;
 
 //#include "ParticleContainer.cpp"
 //using namespace mpacts;
 
 #include "mpicts.cpp"
+#include "Trace.cpp"
 #include "MessageData.cpp"
 #include "MessageBuffer.cpp"
 #include "MessageItemList.cpp"
 #include "MessageHeader.cpp"
 #include "MessageHandler.cpp"
+#include "Codec.cpp"
+#include "StaticMessage.h"
+#include "IdMap.h"
+#include "MemoryPolicy.h"
+#include "PagedArray.h"
+#include "SpaceFillingCurve.h"
 #define PC
 #ifdef PC
 #  include "ParticleContainer.cpp"
@@ -27,6 +38,17 @@ namespace py = pybind11;
 
 using namespace mpi;
 
+namespace test
+{//---------------------------------------------------------------------------------------------------------------------
+ // A particle attribute with padding bytes: sizeof(Flagged) == 8, but only 6 bytes are written.
+    struct Flagged
+    {
+        float   value;
+        int16_t flag;
+    };
+}
+MPI_PACKED_FIELDS(test::Flagged, &test::Flagged::value, &test::Flagged::flag)
+
 namespace test
 {//---------------------------------------------------------------------------------------------------------------------
     bool test_MessageHeader()
@@ -130,6 +152,2111 @@ namespace test
         finalize();
         return true;
     }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_StaticMessage()
+    {
+        init();
+        prdbg("-*# test_StaticMessage() #*-");
+        bool ok = true;
+
+        static_assert( StaticMessage<double,int,float>::is_fixed_size );
+        static_assert( StaticMessage<double,int,float>::fixed_size == 16 );
+        static_assert(!StaticMessage<double,std::vector<int>>::is_fixed_size );
+        {// rank 0 sends the same message to all other ranks, through the normal MessageHandler flow
+            double a = 5;
+            std::vector<int> ints = {1,2,3,4};
+            if( mpi::rank != 0 ) {
+                a = 0;
+                ints.clear();
+            }
+            auto& hndlr = StaticMessageHandler<double,std::vector<int>>::create(a, ints);
+            if( mpi::rank == 0 ) {
+                for( int dst = 1; dst < mpi::size; ++dst )
+                    hndlr.addSendMessage(dst);
+            }
+            MessageHeader::broadcastMessageHeaders();
+            hndlr.sendMessages();
+            hndlr.recvMessages();
+
+            ok = ok && a == 5 && ints == std::vector<int>({1,2,3,4});
+        }
+        {// write and read a message locally
+            double a = 1.5;
+            int    i = 7;
+            std::vector<float> floats = {1,2,3};
+            StaticMessage<double,int,std::vector<float>> msg(a, i, floats);
+            MessageData md(mpi::rank, mpi::rank, 0);
+            ok = ok && msg.computeMessageBufferSize(&md) == sizeof(double) + sizeof(int) + sizeof(size_t) + 3*sizeof(float);
+            md.allocateBuffer();
+            msg.write(&md);
+            a = 0; i = 0; floats.clear();
+            msg.read(&md);
+            ok = ok && a == 1.5 && i == 7 && floats == std::vector<float>({1,2,3});
+        }
+        finalize();
+        return ok;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_NestedContainers()
+    {// write and read nested containers locally
+        init();
+        prdbg("-*# test_NestedContainers() #*-");
+
+        std::vector<std::vector<Index_t>> neighbours = {{1,2,3},{},{4},{5,6}};
+        std::vector<std::string> names = {"a", "", "bc", "def"};
+        std::array<std::vector<float>,3> xyz = {{ {1,2}, {3}, {} }};
+        std::vector<std::vector<std::string>> nested = {{"x","yz"},{},{"","uvw"}};
+        Eigen::Quaternion<float,Eigen::DontAlign> q(1,2,3,4);
+
+        auto const neighbours0 = neighbours;
+        auto const names0 = names;
+        auto const xyz0 = xyz;
+        auto const nested0 = nested;
+        auto const q0 = q;
+
+        MessageHandler::create(); // makes sure MessageHeader::theHeaders is initialized.
+        MessageItemList list;
+        list.push_back(neighbours);
+        list.push_back(names);
+        list.push_back(xyz);
+        list.push_back(nested);
+        list.push_back(q);
+
+        MessageData md(mpi::rank, mpi::rank, 0);
+        size_t nBytes = list.computeMessageBufferSize(&md);
+        bool ok = ( nBytes == (1 + 4)*sizeof(size_t) + 6*sizeof(Index_t)               // neighbours
+                           + (1 + 4)*sizeof(size_t) + 6                                 // names
+                           + (1 + 3)*sizeof(size_t) + 3*sizeof(float)                   // xyz
+                           + (1 + 3 + 4)*sizeof(size_t) + 6                             // nested
+                           + 4*sizeof(float)                                            // q
+                  );
+        md.allocateBuffer();
+        list.write(&md);
+
+        neighbours.clear();
+        names.clear();
+        for( auto& v : xyz ) v.clear();
+        nested.clear();
+        q = Eigen::Quaternion<float,Eigen::DontAlign>(0,0,0,0);
+
+        list.read(&md);
+        ok = ok && neighbours == neighbours0
+                && names == names0
+                && xyz == xyz0
+                && nested == nested0
+                && q.coeffs() == q0.coeffs();
+        finalize();
+        return ok;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_PackedFields()
+    {// write and read a struct without its padding bytes
+        init();
+        prdbg("-*# test_PackedFields() #*-");
+
+        static_assert( sizeof(Flagged) == 8 );
+        static_assert( fixedItemBufferSize<Flagged>() == 6 );
+        static_assert( StaticMessage<Flagged,double>::fixed_size == 14 );
+
+        Flagged f = {1.5f, 3};
+        std::vector<int> ints = {1,2};
+        MessageHandler::create(); // makes sure MessageHeader::theHeaders is initialized.
+        MessageItemList list;
+        list.push_back(f);
+        list.push_back(ints);
+
+        MessageData md(mpi::rank, mpi::rank, 0);
+        bool ok = list.computeMessageBufferSize(&md) == 6 + sizeof(size_t) + 2*sizeof(int);
+        md.allocateBuffer();
+        list.write(&md);
+        f = {0, 0};
+        ints.clear();
+        list.read(&md);
+        ok = ok && f.value == 1.5f && f.flag == 3 && ints == std::vector<int>({1,2});
+
+        finalize();
+        return ok;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_Trace()
+    {// Check that the trace records end up in the trace file
+        trace::theTracer.setLevel(trace::info); // tracing is off by default
+        init();
+        trace::theTracer.setLevel(trace::verbose);
+        trace::theTracer.setMask(trace::all & ~trace::memcpy);
+        {
+            double a = 1.5;
+            std::vector<int> ints = {1,2,3};
+            MessageHandler& hndlr = MessageHandler::create();
+            hndlr.messageItemList().push_back(a);
+            hndlr.messageItemList().push_back(ints);
+            MessageData md(mpi::rank, mpi::rank, hndlr.key());
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md); // two item_written records
+            trace::theTracer.setMask(trace::memcpy);
+            hndlr.messageItemList().read(&md);  // two memcpy_read records
+        }
+        trace::record(trace::memcpy, trace::verbose, trace::user, 1, 2);
+        trace::theTracer.setLevel(trace::info);
+        trace::record(trace::memcpy, trace::verbose, trace::user, 3, 4); // level too high, not recorded
+
+        finalize(); // stops the tracer
+        trace::theTracer.setLevel(trace::off);
+
+        trace::FileHeader fileHeader;
+        std::vector<trace::Record> records = trace::readTraceFile(trace::theTracer.fname(), &fileHeader);
+
+        std::vector<uint16_t> expected =
+          { trace::init
+          , trace::item_written, trace::item_written
+          , trace::memcpy_read, trace::memcpy_read
+          , trace::user
+          };
+        bool ok = fileHeader.rank == mpi::rank
+               && records.size() == expected.size();
+        for( size_t i = 0; ok && i < records.size(); ++i ) {
+            ok = records[i].event == expected[i]
+              && (i == 0 || records[i].time >= records[i-1].time);
+        }
+        ok = ok && records[1].a == sizeof(double)
+                && records[2].a == sizeof(size_t) + 3*sizeof(int)
+                && records[5].a == 1 && records[5].b == 2;
+        return ok;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_Codec()
+    {
+        init();
+        prdbg("-*# test_Codec() #*-");
+        bool ok = true;
+
+     // positions of particles on a lattice, these compress well
+        std::vector<float> x(30000);
+        for( size_t i = 0; i < x.size(); ++i ) x[i] = 0.5f*(i%100) + 0.25f*(i/100);
+        size_t nBytes = x.size()*sizeof(float);
+        {// kernels
+            std::vector<char> raw(nBytes + 3, 'a'), shuffled(nBytes + 3), unshuffled(nBytes + 3); // not a multiple of 4
+            std::memcpy(raw.data(), x.data(), nBytes);
+            codec::shuffle  (raw.data(), raw.size(), 4, shuffled.data());
+            codec::unshuffle(shuffled.data(), raw.size(), 4, unshuffled.data());
+            ok = ok && unshuffled == raw;
+
+            std::vector<char> compressed(nBytes), decompressed(nBytes);
+            size_t n = codec::compress(shuffled.data(), nBytes, compressed.data(), nBytes - 1);
+            ok = ok && n > 0 && n < nBytes/2
+                    && codec::decompress(compressed.data(), n, decompressed.data(), nBytes)
+                    && std::memcmp(decompressed.data(), shuffled.data(), nBytes) == 0;
+
+            std::vector<char> noise(1000);
+            for( auto& c : noise ) c = (char)rand();
+            ok = ok && codec::compress(noise.data(), noise.size(), compressed.data(), noise.size() - 1) == 0;
+        }
+        {// rank 0 sends x to all other ranks, compressed
+            std::vector<float> y(x);
+            if( mpi::rank != 0 ) y.clear();
+            MessageHandler& hndlr = MessageHandler::create();
+            hndlr.messageItemList().push_back(y);
+            hndlr.codec().enable(1024, sizeof(float));
+            if( mpi::rank == 0 ) {
+                for( int dst = 1; dst < mpi::size; ++dst )
+                    hndlr.addSendMessage(dst);
+            }
+            MessageHeader::broadcastMessageHeaders();
+            hndlr.sendMessages();
+            hndlr.recvMessages();
+
+            ok = ok && y == x;
+            codec::Statistics const& statistics = hndlr.codec().statistics();
+            if( mpi::rank == 0 )
+                ok = ok && statistics.nCompressed == size_t(mpi::size - 1)
+                        && (mpi::size == 1 || statistics.ratio() > 2);
+            else
+                ok = ok && statistics.nDecoded == 1;
+        }
+        {// small messages are not compressed, but still framed
+            codec::Codec codec;
+            codec.enable(1024);
+            MessageBuffer frame;
+            std::vector<char> message(100, 'a'), decoded(100);
+            size_t frameSize = codec.encode(message.data(), message.size(), frame);
+            ok = ok && frameSize == 100 + sizeof(codec::FrameHeader)
+                    && codec.decode(frame.ptr(), frameSize, decoded.data(), decoded.size()) == 100
+                    && decoded == message
+                    && codec.statistics().nCompressed == 0;
+        }
+        {// corrupt and truncated frames are rejected, without reading or writing out of bounds
+            codec::Codec codec;
+            codec.enable(1024, sizeof(float));
+            MessageBuffer frame;
+            size_t frameSize = codec.encode(x.data(), nBytes, frame);
+            std::vector<char> decoded(nBytes);
+            char* f = (char*)frame.ptr();
+            codec::FrameHeader header;
+            std::memcpy(&header, f, sizeof(header));
+            ok = ok && header.method == codec::shuffled_lz
+                    && codec.decode(f, frameSize, decoded.data(), nBytes) == nBytes
+                    && codec.decode(f, sizeof(header) - 1, decoded.data(), nBytes) == codec::Codec::badFrame // no header
+                    && codec.decode(f, frameSize - 1, decoded.data(), nBytes) == codec::Codec::badFrame      // truncated
+                    && codec.decode(f, frameSize, decoded.data(), nBytes - 1) == codec::Codec::badFrame;     // does not fit
+            std::vector<char> copy(f, f + frameSize);
+            auto decodeCopy = [&]{ return codec.decode(copy.data(), copy.size(), decoded.data(), nBytes); };
+            copy[0] = 7;                                           // unknown method
+            ok = ok && decodeCopy() == codec::Codec::badFrame;
+            copy[0] = codec::shuffled_lz; copy[1] = 0;              // byte-shuffle without word size
+            ok = ok && decodeCopy() == codec::Codec::badFrame;
+            copy[0] = codec::raw; copy[1] = header.wordSize;        // raw payload of the wrong size
+            ok = ok && decodeCopy() == codec::Codec::badFrame;
+            copy.assign(f, f + frameSize);
+            char* payload = copy.data() + sizeof(header);
+            payload[0] = 0x10; payload[1] = 'a'; payload[2] = char(0xff); payload[3] = char(0xff); // match before the start
+            ok = ok && decodeCopy() == codec::Codec::badFrame;
+        }
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_LossyPrecision()
+    {// Copy particles to the same rank with reduced precision, without MPI communication
+        init();
+        prdbg("-*# test_LossyPrecision() #*-");
+        bool ok = true;
+
+        static_assert( internal::reduced_precision_able<vec_t>::nComponents == 3 );
+        static_assert(!internal::reduced_precision_able<int>::value );
+        {// half precision kernels, including the F16C path (if enabled) and the scalar remainder
+            std::vector<float> x = {0.0f, 1.0f, -2.5f, 65504.0f, 1e-7f, 3.14159f, 100.3f, -0.001f, 1e6f, 0.1f, 2048.5f};
+            std::vector<uint16_t> h(x.size());
+            std::vector<float> y(x.size());
+            internal::pack_half(x.data(), x.size(), h.data());
+            internal::unpack_half(h.data(), h.size(), y.data());
+            for( size_t i = 0; i < x.size(); ++i ) {
+                ok = ok && internal::half_to_float(internal::float_to_half(x[i])) == y[i];
+                if( std::abs(x[i]) > 6.2e-5f && std::abs(x[i]) <= 65504.0f )
+                    ok = ok && std::abs(y[i] - x[i]) <= std::abs(x[i]) * 0.0005f;
+            }
+            ok = ok && y[0] == 0 && y[1] == 1 && y[2] == -2.5f && std::isinf(y[8]);
+        }
+        {// fixed point kernels quantize in the scalar type: for doubles far from 0 the error is still < extent/2^17
+            size_t const n = 13;
+            std::vector<double> x(3*n), y(3*n);
+            for( size_t i = 0; i < x.size(); ++i ) x[i] = 1e6 + (i%3) + 0.5*i/x.size();
+            double const origin[3] = {1e6, 1e6 + 1, 1e6 + 2}, extent[3] = {0.5, 0.5, 0.5};
+            std::vector<char> q(2*x.size() + 1);
+            internal::pack_fixed_point<3>(x.data(), n, origin, extent, q.data() + 1); // unaligned
+            internal::unpack_fixed_point<3>(q.data() + 1, n, origin, extent, y.data());
+            for( size_t i = 0; i < x.size(); ++i )
+                ok = ok && std::abs(y[i] - x[i]) <= 0.5/131072;
+        }
+
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        Indices_t indices = {1,3,5};
+        {// full precision
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            ok = ok && hndlr.messageItemList().computeMessageBufferSize(&md)
+                    == sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices))
+                     + 2*(sizeof(Precision) + 3*sizeof(real_t));
+        }
+        {// r in half precision, m in fixed point, copy mode
+            hndlr.messageItem(pc.r).setPrecision({half_precision});
+            hndlr.messageItem(pc.m).setPrecision({fixed_point, {100.0f*mpi::rank}, {100.0f}});
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            size_t sz = hndlr.messageItemList().computeMessageBufferSize(&md);
+            ok = ok && sz == sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices))
+                           + sizeof(Precision) + 3*sizeof(uint16_t)
+                           + sizeof(Precision) + 2*sizeof(real_t) + 3*sizeof(uint16_t);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            hndlr.messageItemList().read(&md); // creates 3 new particles
+            for( size_t i = 0; i < indices.size(); ++i ) {
+                Index_t src = indices[i];
+                Index_t dst = md.indices()[i];
+                ok = ok && dst >= 8
+                        && std::abs(pc.r[dst] - pc.r[src]) <= std::abs(pc.r[src]) * 0.0005f
+                        && std::abs(pc.m[dst] - pc.m[src]) <= 100.0f/65536;
+            }
+        }
+        {// move mode is always lossless
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, move);
+            ok = ok && hndlr.messageItemList().computeMessageBufferSize(&md)
+                    == sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices))
+                     + 2*(sizeof(Precision) + 3*sizeof(real_t));
+        }
+        {// a double array far from 0, in fixed point: the origin and extent are sent as doubles
+            ParticleContainer pc2(8, "PC2");
+            ParticleArray<double> t("t", pc2);
+            for( Index_t i = 0; i < 8; ++i ) t[i] = 1e6 + 0.1*i;
+            PcMessageHandler& hndlr2 = PcMessageHandler::create(pc2, {"t"});
+            hndlr2.messageItem(t).setPrecision({fixed_point, {1e6}, {1.0}});
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            hndlr2.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr2.messageItemList().write(&md);
+            hndlr2.messageItemList().read(&md);
+            for( size_t i = 0; i < indices.size(); ++i )
+                ok = ok && std::abs(t[md.indices()[i]] - t[indices[i]]) <= 1.0/131072;
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_DeltaEncoding()
+    {// Update particles in set mode on the same rank, without MPI communication
+        init();
+        prdbg("-*# test_DeltaEncoding() #*-");
+        bool ok = true;
+
+        {// kernels
+            std::vector<float> prev(11), cur(11);
+            for( size_t i = 0; i < prev.size(); ++i ) {
+                prev[i] = 10.0f + i;
+                cur [i] = prev[i] + (i%3)*1e-5f; // every third value is unchanged
+            }
+            size_t nBytes = prev.size()*sizeof(float) - 1; // a trailing byte that is not part of a word
+            std::vector<char> encoded(nBytes), decoded(nBytes);
+            size_t n = delta::encode(cur.data(), prev.data(), nBytes, encoded.data(), nBytes);
+            ok = ok && n > 0 && n < nBytes/2
+                    && delta::decode(encoded.data(), prev.data(), nBytes, decoded.data()) == n
+                    && std::memcmp(decoded.data(), cur.data(), nBytes) == 0;
+            for( auto& x : cur ) x = -x; // all bits of the sign change
+            ok = ok && delta::encode(cur.data(), prev.data(), nBytes, encoded.data(), nBytes) == 0;
+        }
+
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        hndlr.messageItem(pc.r).setDeltaEncoding();
+        hndlr.messageItem(pc.m).setDeltaEncoding();
+        Indices_t indices = {1,3,5,6};
+        std::vector<size_t> nBytesWritten;
+        for( int step = 0; step < 3; ++step )
+        {// the particles move a little, the masses remain the same
+            for( auto i : indices ) pc.r[i] += 0.001f;
+            std::vector<real_t> r, m;
+            for( auto i : indices ) {
+                r.push_back(pc.r[i]);
+                m.push_back(pc.m[i]);
+            }
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            size_t capacity = hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            nBytesWritten.push_back( hndlr.messageItemList().write(&md) );
+            ok = ok && nBytesWritten.back() <= capacity;
+            for( auto i : indices ) pc.r[i] = pc.m[i] = -1;
+            hndlr.messageItemList().read(&md);
+            for( size_t j = 0; j < indices.size(); ++j )
+                ok = ok && pc.r[indices[j]] == r[j] && pc.m[indices[j]] == m[j];
+        }
+     // The first message contains the snapshots, the next ones are delta encoded.
+        ok = ok && nBytesWritten[1] < nBytesWritten[0] && nBytesWritten[2] < nBytesWritten[0];
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_IndexCoding()
+    {
+        init();
+        prdbg("-*# test_IndexCoding() #*-");
+        bool ok = true;
+
+        auto roundtrip = [](Indices_t const& indices, index_coding::Method expected, size_t maxSize) -> bool
+        {
+            index_coding::Choice choice = index_coding::choose(indices);
+            std::vector<char> buffer(choice.size);
+            void* pos = buffer.data();
+            index_coding::encode(indices, pos);
+            bool ok = (char*)pos - buffer.data() == (std::ptrdiff_t)choice.size
+                   && choice.method == expected
+                   && choice.size <= maxSize;
+            Indices_t decoded;
+            pos = buffer.data();
+            index_coding::decode(pos, indices.size(), decoded);
+            return ok && decoded == indices && (char*)pos - buffer.data() == (std::ptrdiff_t)choice.size;
+        };
+
+        Indices_t contiguous, dense, sparse, unsorted, huge;
+        for( Index_t i = 0; i < 1000; ++i ) contiguous.push_back(10 + i);
+        contiguous.push_back(5000);
+        for( Index_t i = 0; i < 1000; ++i ) dense.push_back(3*i);
+        for( Index_t i = 0; i < 1000; ++i ) sparse.push_back(1000*i + i%7);
+        for( Index_t i = 0; i < 1000; ++i ) unsorted.push_back( (i*2654435761u) % 4000000000u );
+        for( Index_t i = 0; i < 1000; ++i ) huge.push_back( (i%2 ? Index_t(1) << 62 : 0) + i );
+
+        ok = ok && roundtrip(contiguous, index_coding::ranges, 10);
+        ok = ok && roundtrip(dense     , index_coding::bitmap, 1 + 4 + 3000/8);
+        ok = ok && roundtrip(sparse    , index_coding::deltas, 1 + 2*1000);
+        ok = ok && roundtrip(unsorted  , index_coding::int32 , 1 + 4*1000);
+        ok = ok && roundtrip(huge      , index_coding::int64 , 1 + 8*1000);
+        ok = ok && roundtrip(Indices_t(), index_coding::int64, 1);
+        ok = ok && roundtrip(Indices_t({7,3,5}), index_coding::deltas, 4); // order is preserved
+
+#ifdef PC
+        {// set mode messages carry the encoded IDs of the selection
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            Indices_t indices = {2,3,4,7};
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            size_t sz = hndlr.messageItemList().computeMessageBufferSize(&md);
+            ok = ok && sz == sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices))
+                           + 2*(sizeof(Precision) + sizeof(delta::Method) + 4*sizeof(real_t));
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            md.indices().clear();
+            hndlr.messageItemList().read(&md);
+            ok = ok && md.indices() == indices;
+        }
+#endif
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+    template<typename T>
+    bool check_write_n_read_n(std::vector<T> const& a, Indices_t const& indices)
+    {// write_n and read_n must be equivalent to ::mpi::write and ::mpi::read per element
+        size_t nBytes = indices.size()*fixedItemBufferSize<T>();
+        std::vector<char> expected(nBytes), buffer(nBytes);
+        std::vector<T> b(a);
+        void* pos = expected.data();
+        for( auto i : indices ) ::mpi::write(b[i], pos);
+
+        pos = buffer.data();
+        write_n(a, indices, pos);
+        bool ok = (char*)pos - buffer.data() == (std::ptrdiff_t)nBytes && buffer == expected;
+
+        for( auto i : indices ) std::memset((void*)&b[i], 0, sizeof(T)); // (T() leaves an Eigen vector uninitialized)
+        pos = buffer.data();
+        read_n(b, indices, pos);
+        ok = ok && (char*)pos - buffer.data() == (std::ptrdiff_t)nBytes;
+        for( auto i : indices ) ok = ok && std::memcmp(&b[i], &a[i], fixedItemBufferSize<T>()) == 0;
+        return ok;
+    }
+
+#ifdef PC
+    bool test_ParticleMajor()
+    {// Copy, move and set particles to the same rank in particle_major layout, without MPI communication
+        init();
+        prdbg("-*# test_ParticleMajor() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        hndlr.setLayout(particle_major);
+        Indices_t indices = {1,3,4};
+        {// copy: the message contains r and m of particle 1, then r and m of particle 3, ...
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            size_t sz = hndlr.messageItemList().computeMessageBufferSize(&md);
+            size_t header = sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices));
+            ok = ok && sz == header + 3*2*sizeof(real_t);
+            md.allocateBuffer();
+            ok = ok && hndlr.messageItemList().write(&md) == sz
+                    && md.layout() == particle_major;
+            std::vector<real_t> data(3*2); // the encoded IDs leave the data unaligned
+            std::memcpy(data.data(), (char const*)md.bufferPtr() + header, data.size()*sizeof(real_t));
+            for( size_t i = 0; i < indices.size(); ++i )
+                ok = ok && data[2*i] == pc.r[indices[i]] && data[2*i + 1] == pc.m[indices[i]];
+            hndlr.messageItemList().read(&md); // creates 3 new particles
+            for( size_t i = 0; i < indices.size(); ++i ) {
+                Index_t src = indices[i], dst = md.indices()[i];
+                ok = ok && dst >= 8 && pc.r[dst] == pc.r[src] && pc.m[dst] == pc.m[src];
+            }
+        }
+        {// move
+            real_t r3 = pc.r[3], m3 = pc.m[3];
+            PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({3}), move);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            ok = ok && !pc.is_alive(3);
+            hndlr.messageItemList().read(&md); // reuses the slot of particle 3
+            Index_t dst = md.indices()[0];
+            ok = ok && pc.is_alive(dst) && pc.r[dst] == r3 && pc.m[dst] == m3;
+        }
+        {// set, with delta encoding, falls back to array_major
+            hndlr.messageItem(pc.m).setDeltaEncoding();
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            ok = ok && md.layout() == array_major;
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_BulkTransfer()
+    {
+        init();
+        prdbg("-*# test_BulkTransfer() #*-");
+        bool ok = true;
+
+        size_t const n = 2000;
+        std::vector<float>   f(n);
+        std::vector<double>  d(n);
+        std::vector<vec_t>   v(n);
+        std::vector<Flagged> p(n);
+        for( size_t i = 0; i < n; ++i ) {
+            f[i] = i; d[i] = -double(i); v[i] = vec_t(i, 2*i, 3*i);
+            p[i].value = i; p[i].flag = int16_t(i);
+        }
+        std::vector<Indices_t> selections(4);
+        for( Index_t i = 100; i < 200; ++i ) selections[0].push_back(i);                 // one run
+        for( Index_t i = 0; i < 1000; ++i ) selections[1].push_back( i%10 < 6 ? i : 1000 + (i*37)%1000 ); // runs and scattered indices
+        for( Index_t i = 0; i < 1000; ++i ) selections[2].push_back( (i*7919) % n );     // scattered (and prefetched)
+        selections[3] = {5, 3, 1999, 0, 1, 2};                                            // short
+        for( auto const& indices : selections ) {
+            ok = ok && check_write_n_read_n(f, indices)
+                    && check_write_n_read_n(d, indices)
+                    && check_write_n_read_n(v, indices)
+                    && check_write_n_read_n(p, indices);
+        }
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_AlignedLayout()
+    {// Copy and set particles to the same rank with 64 byte aligned items, without MPI communication
+        init();
+        prdbg("-*# test_AlignedLayout() #*-");
+        bool ok = true;
+
+        ok = ok && padBytes<8>(5) == 8 && padBytes<8,4>(5) == 2 && padBytes(65, 64) == 128 && padBytes(64, 64) == 64;
+
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        hndlr.messageItemList().setAlignment(64);
+        Indices_t indices = {1,3,4};
+        {// copy: [size,mode,layout | pad] [precision | pad] [r (3 floats) | pad] [precision | pad] [m (3 floats)]
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            ok = ok && hndlr.messageItemList().computeMessageBufferSize(&md) == 64 + 2*(64 + 64);
+            md.allocateBuffer();
+            ok = ok && (uintptr_t)md.bufferPtr() % MessageBuffer::alignment == 0
+                    && hndlr.messageItemList().write(&md) == 64 + 128 + 64 + 3*sizeof(real_t);
+         // the received arrays can be used in place
+            real_t const* r = (real_t const*)((char const*)md.bufferPtr() + 128);
+            real_t const* m = (real_t const*)((char const*)md.bufferPtr() + 256);
+            Eigen::Map<Eigen::Matrix<real_t,3,1> const, Eigen::Aligned64> rMap(r);
+            for( size_t i = 0; i < indices.size(); ++i )
+                ok = ok && rMap[i] == pc.r[indices[i]] && m[i] == pc.m[indices[i]];
+            hndlr.messageItemList().read(&md);
+            for( size_t i = 0; i < indices.size(); ++i ) {
+                Index_t src = indices[i], dst = md.indices()[i];
+                ok = ok && pc.r[dst] == pc.r[src] && pc.m[dst] == pc.m[src];
+            }
+        }
+        {// set, delta encoded and in half precision
+            hndlr.messageItem(pc.r).setDeltaEncoding();
+            PrecisionPolicy half;
+            half.precision = half_precision;
+            hndlr.messageItem(pc.m).setPrecision(half);
+            for( int step = 0; step < 2; ++step ) {
+                for( auto i : indices ) {
+                    pc.r[i] += 0.5f;
+                    pc.m[i] = 0.25f*i;
+                }
+                std::vector<real_t> r, m;
+                for( auto i : indices ) {
+                    r.push_back(pc.r[i]);
+                    m.push_back(pc.m[i]);
+                }
+                PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+                size_t capacity = hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                ok = ok && hndlr.messageItemList().write(&md) <= capacity;
+                for( auto i : indices ) pc.r[i] = pc.m[i] = -1;
+                hndlr.messageItemList().read(&md);
+                for( size_t j = 0; j < indices.size(); ++j )
+                    ok = ok && pc.r[indices[j]] == r[j] && pc.m[indices[j]] == m[j];
+            }
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_FreeList()
+    {
+        init();
+        prdbg("-*# test_FreeList() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(8, "PC");
+        pc.remove(2);
+        pc.remove(5);
+        pc.remove(5); // removing a dead particle has no effect
+        ok = ok && pc.nFree() == 2 && !pc.is_alive(2) && !pc.is_alive(5);
+        Index_t i = pc.add(); // the last removed particle
+        ok = ok && i == 5 && pc.is_alive(5) && pc.nFree() == 1;
+        Indices_t indices = pc.addN(5); // particle 2, and 4 new particles
+        ok = ok && indices == Indices_t({2, 8, 9, 10, 11}) && pc.size() == 12 && pc.nFree() == 0
+                && pc.r.size() == 12 && pc.m.size() == 12;
+        for( Index_t j = 0; j < (Index_t)pc.size(); ++j )
+            ok = ok && pc.is_alive(j);
+        indices = pc.addN(2); // grows by a factor 1.5
+        ok = ok && indices == Indices_t({12, 13}) && pc.size() == 18 && pc.nFree() == 4
+                && pc.add() == 14;
+        ok = ok && pc.addN(0).empty();
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_AliveMask()
+    {
+        init();
+        prdbg("-*# test_AliveMask() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(150, "PC");
+        ok = ok && pc.nAlive() == 150 && pc.countAlive(0, 150) == 150 && pc.select(false).empty();
+        for( Index_t i = 0; i < 150; ++i )
+            if( i%3 == 0 || i == 64 || i == 127 || i == 128 || i == 149 ) pc.remove(i);
+
+        auto check = [&pc]() -> bool
+        {// compare with a scalar loop over is_alive()
+            bool ok = true;
+            Indices_t alive, dead, iterated, visited;
+            for( Index_t i = 0; i < (Index_t)pc.size(); ++i )
+                (pc.is_alive(i) ? alive : dead).push_back(i);
+            for( Index_t i : pc.alive() ) iterated.push_back(i);
+            pc.forEachAlive( [&visited](Index_t i) { visited.push_back(i); } );
+            ok = ok && pc.nAlive() == alive.size() && iterated == alive && visited == alive
+                    && pc.select() == alive && pc.select(false) == dead;
+            for( auto range : std::vector<std::pair<Index_t,Index_t>>({ {5,70}, {64,128}, {63,65}, {10,10}, {149,150}, {0,1} }) )
+            {
+                Index_t b = range.first, e = range.second;
+                Indices_t expectedAlive, expectedDead;
+                for( Index_t i = b; i < e; ++i )
+                    (pc.is_alive(i) ? expectedAlive : expectedDead).push_back(i);
+                ok = ok && pc.select(true, b, e) == expectedAlive && pc.select(false, b, e) == expectedDead
+                        && pc.countAlive(b, e) == expectedAlive.size();
+            }
+            return ok;
+        };
+        ok = ok && check() && pc.nAlive() == 150 - 50 - 4;
+        pc.addN(pc.nFree() + 10); // grows by a factor 1.5 and takes the new particles first, the others stay dead
+        ok = ok && check() && pc.nAlive() == 160 && pc.size() == 225 && pc.countAlive(150, 225) == 64;
+        pc.remove(200);
+        pc.add();
+        ok = ok && check() && pc.nAlive() == 160 && pc.nFree() == 65;
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_Compaction()
+    {
+        init();
+        prdbg("-*# test_Compaction() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(100, "PC");
+        ParticleArray<Index_t> tag("tag", pc);
+        ParticleArray<std::vector<int>> v("v", pc);
+        for( Index_t i = 0; i < 100; ++i ) {
+            tag[i] = i;
+            v[i].assign(i%3, int(i));
+        }
+        ok = ok && pc.arrays().size() == 6; // r, m, the IDs, the handle slots, tag and v
+        {// copies are registered too, and unregistered when destroyed
+            ParticleArray<Index_t> copy(tag);
+            ok = ok && pc.arrays().size() == 7;
+        }
+        ok = ok && pc.arrays().size() == 6;
+
+        for( Index_t i = 0; i < 100; ++i )
+            if( i%4 == 1 || i >= 90 ) pc.remove(i);
+        Index_t const nAlive = pc.nAlive(); // 100 - 23 - 10 = 67
+        ok = ok && nAlive == 67 && pc.nMisplaced() == pc.countAlive(nAlive, pc.size());
+        Indices_t remap;
+        pc.setCompactionThreshold(0.5);
+        ok = ok && !pc.compactIfFragmented(remap) && remap.empty();
+        pc.setCompactionThreshold(0.1);
+        ok = ok && pc.compactIfFragmented(remap) && remap.size() == 100;
+        ok = ok && pc.nAlive() == size_t(nAlive) && pc.size() == 100 && pc.nMisplaced() == 0
+                && pc.countAlive(0, nAlive) == size_t(nAlive) && pc.nFree() == size_t(100 - nAlive);
+        for( Index_t i = 0; i < 100; ++i )
+        {
+            bool alive = !(i%4 == 1 || i >= 90);
+            if( !alive ) {
+                ok = ok && remap[i] == -1;
+                continue;
+            }
+            Index_t j = remap[i];
+            ok = ok && j >= 0 && j < nAlive && (i >= nAlive || j == i) // particles in the prefix do not move
+                    && tag[j] == i && v[j] == std::vector<int>(i%3, int(i))
+                    && pc.id(j) == (Id_t(mpi::rank) << 40) + i && pc.index(pc.id(j)) == j // the ID map follows
+                    && pc.r[j] == 100*mpi::rank + i && pc.m[j] == 100*mpi::rank + i + 100;
+        }
+        ok = ok && pc.add() == nAlive; // the lowest free slot
+        pc.remove(nAlive);
+
+        pc.remove(3);
+        pc.remove(60);
+        Indices_t before(tag.begin(), tag.begin() + nAlive);
+        remap = pc.compact(true); // shrink
+        ok = ok && pc.size() == size_t(nAlive - 2) && pc.nAlive() == pc.size() && pc.nFree() == 0
+                && tag.size() == pc.size() && v.size() == pc.size() && pc.r.size() == pc.size()
+                && remap[3] == -1 && remap[60] == -1 && pc.nMisplaced() == 0;
+        for( Index_t i = 0; i < nAlive; ++i )
+            if( i != 3 && i != 60 )
+                ok = ok && tag[remap[i]] == before[i];
+        Index_t i = pc.add(); // grows all registered arrays
+        ok = ok && i == nAlive - 2 && tag.size() == pc.size() && v.size() == pc.size() && pc.size() > size_t(nAlive - 2);
+
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_IdMap()
+    {
+        init();
+        prdbg("-*# test_IdMap() #*-");
+        bool ok = true;
+
+        {// insert, find, update and erase, against std::map, with many removals
+            IdMap map(4);
+            std::map<Id_t, Index_t> reference;
+            uint64_t x = 12345;
+            for( int step = 0; step < 20000; ++step )
+            {
+                x = x*6364136223846793005ull + 1442695040888963407ull;
+                Id_t id = (x >> 33) % 3000;
+                Index_t index = step;
+                if( (x >> 20) % 3 ) {
+                    bool inserted = map.insert(id, index);
+                    ok = ok && inserted == (reference.count(id) == 0);
+                    if( inserted ) reference[id] = index;
+                } else {
+                    auto iter = reference.find(id);
+                    bool present = iter != reference.end();
+                    ok = ok && !map.erase(id, -2) // wrong index
+                            && map.erase(id, present ? iter->second : -1) == present;
+                    if( present ) reference.erase(iter);
+                }
+            }
+            ok = ok && map.size() == reference.size();
+            for( Id_t id = 0; id < 3000; ++id ) {
+                auto iter = reference.find(id);
+                ok = ok && map.find(id) == (iter == reference.end() ? -1 : iter->second);
+            }
+            std::vector<Id_t> ids;
+            for( Id_t id = 2999; id >= 0; id -= 7 ) ids.push_back(id);
+            Indices_t indices = map.find(ids); // batched
+            for( size_t k = 0; k < ids.size(); ++k )
+                ok = ok && indices[k] == map.find(ids[k]);
+            Id_t id = reference.begin()->first;
+            Index_t index = reference.begin()->second;
+            ok = ok && !map.update(id, index + 1, 0) && map.update(id, index, 7) && map.find(id) == 7;
+            map.clear();
+            ok = ok && map.empty() && map.find(id) == -1;
+        }
+#ifdef PC
+        {// the ID map of a ParticleContainer follows add(), remove() and migration
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            Id_t const base = Id_t(mpi::rank) << 40;
+            for( Index_t i = 0; i < 8; ++i )
+                ok = ok && pc.id(i) == base + i && pc.index(base + i) == i;
+            pc.remove(2);
+            ok = ok && pc.index(base + 2) == -1 && pc.idMap().size() == 7;
+            Index_t i = pc.add(); // a new particle gets a new ID
+            ok = ok && i == 2 && pc.id(2) == base + 8 && pc.index(base + 8) == 2;
+         // move particles 5 and 6 to this rank: they keep their IDs, in new slots
+            real_t r5 = pc.r[5];
+            {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({5,6}), move);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                ok = ok && pc.index(base + 5) == -1 && pc.index(base + 6) == -1;
+                hndlr.messageItemList().read(&md);
+                ok = ok && pc.index(base + 5) == md.indices()[0] && pc.index(base + 6) == md.indices()[1]
+                        && pc.r[pc.index(base + 5)] == r5;
+            }
+         // set mode updates the particles by ID, wherever they are
+            pc.r[pc.index(base + 5)] = -5;
+            {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({pc.index(base + 5)}), set);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                pc.r[pc.index(base + 5)] = 0;
+                md.indices().clear();
+                hndlr.messageItemList().read(&md);
+                ok = ok && md.indices() == Indices_t({pc.index(base + 5)}) && pc.r[pc.index(base + 5)] == -5;
+            }
+         // a copy on the same rank is a ghost: the original is found first
+            {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({0}), copy);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                hndlr.messageItemList().read(&md);
+                Index_t copy = md.indices()[0];
+                ok = ok && pc.id(copy) == base && pc.index(base) == 0 && pc.is_ghost(copy)
+                        && pc.ghostIdMap().find(base) == copy;
+                pc.clearGhosts();
+                ok = ok && pc.index(base) == 0 && pc.ghostIdMap().empty();
+            }
+        }
+#endif
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_ArraySubsets()
+    {// Handlers for different subsets of the ParticleArrays, on the same rank, without MPI communication
+        init();
+        prdbg("-*# test_ArraySubsets() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(8, "PC");
+        ParticleArray<int> q("q", pc);
+        ok = q.size() == pc.capacity(); // sized by the container
+        for( Index_t i = 0; i < 8; ++i ) q[i] = int(10*i);
+        ok = ok && pc.arrayNames() == std::vector<std::string>({"r", "m", "q"}) // the IDs are not listed
+                && pc.array("q") == &q && pc.array("x") == nullptr;
+
+        PcMessageHandler& migration = PcMessageHandler::create(pc); // all arrays
+        PcMessageHandler& ghosts = PcMessageHandler::create(pc, {"r"});
+        ok = ok && migration.hasParticleArray(pc.r) && migration.hasParticleArray(pc.m) && migration.hasParticleArray(q)
+                && ghosts.hasParticleArray(pc.r) && !ghosts.hasParticleArray(pc.m) && !ghosts.hasParticleArray(q);
+
+        Indices_t indices = {1,2,5};
+        size_t header = sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices));
+        {// ghost updates carry the positions only
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            size_t sz = ghosts.messageItemList().computeMessageBufferSize(&md);
+            ok = ok && sz == header + sizeof(Precision) + sizeof(delta::Method) + 3*sizeof(real_t);
+            md.allocateBuffer();
+            ghosts.messageItemList().write(&md);
+            for( auto i : indices ) {
+                pc.r[i] = -1;
+                pc.m[i] = -1;
+            }
+            ghosts.messageItemList().read(&md);
+            for( auto i : indices )
+                ok = ok && pc.r[i] == 100*mpi::rank + i && pc.m[i] == -1;
+        }
+        {// migration carries every attribute
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            size_t sz = migration.messageItemList().computeMessageBufferSize(&md);
+            ok = ok && sz == header + 3*sizeof(Precision) + 2*3*sizeof(real_t) + 3*sizeof(int);
+            md.allocateBuffer();
+            migration.messageItemList().write(&md);
+            migration.messageItemList().read(&md);
+            for( size_t j = 0; j < indices.size(); ++j ) {
+                Index_t src = indices[j], dst = md.indices()[j];
+                ok = ok && pc.r[dst] == pc.r[src] && pc.m[dst] == pc.m[src] && q[dst] == q[src];
+            }
+        }
+     // arrays can be added by name later
+        ParticleArray<double> w("w", pc);
+        ghosts.addParticleArray("w");
+        ok = ok && ghosts.hasParticleArray(w) && ghosts.messageItem(w).elementSize() == sizeof(double);
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_Reorder()
+    {
+        init();
+        prdbg("-*# test_Reorder() #*-");
+        bool ok = true;
+
+        {// keys
+            ok = ok && sfc::mortonKey(1,0,0) == 4 && sfc::mortonKey(0,1,0) == 2 && sfc::mortonKey(0,0,1) == 1
+                    && sfc::mortonKey(3,0,0) == 4 + 32 && sfc::spread3(0x1fffff) == 0x1249249249249249ull
+                    && sfc::quantize(0.0f, 0, 1) == 0 && sfc::quantize(2.0f, 0, 1) == (1u << 21) - 1;
+         // successive cells of the Hilbert curve are adjacent
+            int const bits = 3, n = 1 << bits;
+            std::vector<std::array<int,3>> cells(n*n*n);
+            std::vector<bool> seen(n*n*n, false);
+            for( int x = 0; x < n; ++x )
+                for( int y = 0; y < n; ++y )
+                    for( int z = 0; z < n; ++z ) {
+                        uint64_t key = sfc::hilbertKey(x, y, z, bits);
+                        ok = ok && key < seen.size() && !seen[key];
+                        if( key < seen.size() ) {
+                            seen[key] = true;
+                            cells[key] = {x, y, z};
+                        }
+                    }
+            for( size_t k = 1; k < cells.size(); ++k )
+                ok = ok && std::abs(cells[k][0] - cells[k-1][0]) + std::abs(cells[k][1] - cells[k-1][1])
+                         + std::abs(cells[k][2] - cells[k-1][2]) == 1;
+        }
+        {// radix sort, against std::stable_sort
+            std::vector<uint64_t> keys;
+            uint64_t x = 1;
+            for( int i = 0; i < 5000; ++i ) {
+                x = x*6364136223846793005ull + 1442695040888963407ull;
+                keys.push_back( i%2 ? x >> 40 : x ); // some passes are skipped for the small keys
+            }
+            std::vector<int> values(keys.size());
+            for( size_t i = 0; i < values.size(); ++i ) values[i] = int(i);
+            std::vector<int> expected = values;
+            std::stable_sort(expected.begin(), expected.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+            std::vector<uint64_t> sorted = keys;
+            sfc::radixSort(sorted, values);
+            ok = ok && values == expected && std::is_sorted(sorted.begin(), sorted.end());
+        }
+#ifdef PC
+        {// reorder a ParticleContainer with particles on a 4x4x4 grid, in scrambled order
+            ParticleContainer pc(64, "PC");
+            ParticleArray<std::array<uint32_t,3>> cell("cell", pc);
+            for( Index_t i = 0; i < 64; ++i ) {
+                uint32_t c = (i*37) % 64;
+                cell[i] = {c/16, (c/4)%4, c%4};
+            }
+            for( Index_t i : {3, 17, 40, 41} ) pc.remove(i);
+            auto runs = [](Indices_t const& indices) {// the number of runs of consecutive indices
+                size_t n = 0;
+                for( size_t k = 0; k < indices.size(); ++k )
+                    if( k == 0 || indices[k] != indices[k-1] + 1 ) ++n;
+                return n;
+            };
+            auto slab = [&pc, &cell]() {// the particles with x < 2, an octant aligned boundary layer
+                Indices_t indices;
+                for( Index_t i : pc.alive() )
+                    if( cell[i][0] < 2 ) indices.push_back(i);
+                return indices;
+            };
+            size_t runsBefore = runs(slab());
+            std::vector<real_t> r(pc.r.begin(), pc.r.end());
+            std::vector<Id_t> ids;
+            for( Index_t i = 0; i < 64; ++i ) ids.push_back(pc.id(i));
+            std::vector<uint64_t> keys(pc.size());
+            for( Index_t i = 0; i < 64; ++i ) keys[i] = sfc::mortonKey(cell[i][0], cell[i][1], cell[i][2]);
+            Indices_t remap = pc.reorder(keys);
+            ok = ok && pc.nAlive() == 60 && pc.nMisplaced() == 0 && remap.size() == 64;
+            for( Index_t i = 0; i < 64; ++i ) {
+                Index_t j = remap[i];
+                if( j < 0 ) continue;
+                ok = ok && pc.r[j] == r[i] && pc.id(j) == ids[i] && pc.index(ids[i]) == j
+                        && sfc::mortonKey(cell[j][0], cell[j][1], cell[j][2]) == keys[i];
+            }
+            for( Index_t p = 1; p < 60; ++p )
+                ok = ok && sfc::mortonKey(cell[p][0], cell[p][1], cell[p][2])
+                         > sfc::mortonKey(cell[p-1][0], cell[p-1][1], cell[p-1][2]);
+         // the boundary layer is now contiguous
+            Indices_t selection = slab();
+            ok = ok && runsBefore > 1 && runs(selection) == 1;
+            Indices_t indices = {3, 0, 17};
+            ParticleContainer::remapIndices(indices, remap);
+            ok = ok && indices == Indices_t({-1, remap[0], -1});
+        }
+#endif
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_Reserve()
+    {
+        init();
+        prdbg("-*# test_Reserve() #*-");
+        bool ok = true;
+
+        {// reserve() grows once, for any number of additions
+            ParticleContainer pc(100, "PC");
+            pc.reserve(500);
+            size_t capacity = pc.capacity();
+            ok = ok && pc.nGrows() == 1 && capacity == 600 && pc.nFree() == 500;
+            pc.addN(200);
+            for( int i = 0; i < 300; ++i ) pc.add();
+            ok = ok && pc.nGrows() == 1 && pc.capacity() == capacity && pc.nAlive() == 600;
+            pc.remove(5);
+            pc.reserve(1); // there is room already
+            ok = ok && pc.nGrows() == 1;
+        }
+        {// the number of new particles can be read from a message without reading it
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            for( Mode mode : {copy, set} ) {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({1,2,6}), mode);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                ok = ok && MessageItem<ParticleContainer>::nNewParticles(md.bufferPtr()) == (mode == set ? 0 : 3);
+            }
+        }
+        if( mpi::size >= 2 )
+        {// every rank copies 5 particles to every other rank: the receiving ParticleContainer grows once
+            ParticleContainer pc(40, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            for( int dst = 0; dst < mpi::size; ++dst )
+                if( dst != mpi::rank )
+                    hndlr.addSendMessage(dst, Indices_t({0, 7, 8, 9, 30}), copy);
+            MessageHeader::broadcastMessageHeaders();
+            hndlr.sendMessages();
+            hndlr.recvMessages();
+            ok = ok && pc.nGrows() == 1 && pc.nAlive() == size_t(40 + 5*(mpi::size - 1));
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_GhostRegion()
+    {// Ghosts are appended behind the owned particles, survive growth and compaction of the owned region,
+     // and are cleared at once.
+        init();
+        prdbg("-*# test_GhostRegion() #*-");
+        bool ok = true;
+        {
+            ParticleContainer pc(100, "PC");
+            pc.remove(3);
+            pc.remove(10);
+            Id_t const g0 = Id_t(1) << 50;
+            Indices_t ghosts = pc.addGhosts({g0, g0 + 1, g0 + 2});
+            ok = ok && ghosts == Indices_t({100, 101, 102}) && pc.nGhosts() == 3 && pc.nOwned() == 98
+                    && pc.nAlive() == 101 && pc.is_ghost(101) && !pc.is_ghost(99) && pc.index(g0 + 1) == 101;
+            for( size_t k = 0; k < ghosts.size(); ++k ) pc.r[ghosts[k]] = -1.0f - k;
+         // owned particles are taken from the free list, not from the ghost region
+            Index_t i = pc.add();
+            ok = ok && !pc.is_ghost(i) && pc.nOwned() == 99;
+         // growing the owned region moves the ghosts up (one slot is free already)
+            pc.reserve(200);
+            ok = ok && pc.ghostBegin() == Index_t(pc.ownedCapacity()) && pc.ownedCapacity() == 100 + 199
+                    && pc.index(g0 + 1) == pc.ghostBegin() + 1 && pc.r[pc.ghostBegin() + 2] == -3.0f
+                    && pc.countAlive(0, pc.capacity()) == pc.nAlive()
+                    && pc.countAlive(pc.ghostBegin(), pc.ghostEnd()) == 3;
+            pc.addN(150);
+            Index_t const ghost = pc.ghostBegin();
+         // compaction with shrink moves the ghosts down, behind the owned particles
+            Indices_t remap = pc.compact(true);
+            ok = ok && pc.nMisplaced() == 0 && pc.ownedCapacity() == pc.nOwned() && pc.nOwned() == 249
+                    && pc.capacity() == 249 + 3 && remap[ghost] == 249 && pc.index(g0) == 249
+                    && pc.r[249] == -1.0f && pc.r[251] == -3.0f && pc.countAlive(0, pc.capacity()) == pc.nAlive();
+         // clearing the ghosts leaves the owned particles untouched, the ghost region is reused
+            size_t nGrows = pc.nGrows();
+            pc.clearGhosts();
+            ok = ok && pc.nGhosts() == 0 && pc.nAlive() == 249 && pc.index(g0) == -1
+                    && pc.countAlive(0, pc.capacity()) == 249;
+            ghosts = pc.addGhosts({g0 + 5, g0 + 6});
+            ok = ok && ghosts == Indices_t({249, 250}) && pc.nGrows() == nGrows && pc.index(g0 + 6) == 250;
+        }
+        {// received copies are ghosts, moved particles are owned, set messages refresh ghosts
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            Id_t const id1 = pc.id(1), id5 = pc.id(5);
+            for( Mode mode : {copy, move} ) {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({1, 2}), mode);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                hndlr.messageItemList().read(&md);
+                if( mode == copy )
+                    ok = ok && md.indices() == Indices_t({8, 9}) && pc.nGhosts() == 2;
+                else
+                    ok = ok && !pc.is_ghost(md.indices()[0]) && !pc.is_ghost(md.indices()[1]) && pc.nGhosts() == 2;
+            }
+         // the moved particle is found first, the ghost remains in the ghost ID map
+            Index_t ghost = pc.ghostIdMap().find(id1);
+            ok = ok && pc.is_ghost(ghost) && !pc.is_ghost(pc.index(id1));
+         // the owner of particle 5 updates its ghost (here, the owner is gone by the time the update is read)
+            pc.clearGhosts();
+            ghost = pc.addGhosts({id5})[0];
+            pc.r[ghost] = 0;
+            pc.r[5] = -7;
+            {
+                PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({5}), set);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                pc.remove(5);
+                md.indices().clear();
+                hndlr.messageItemList().read(&md);
+                ok = ok && pc.nGhosts() == 1 && md.indices() == Indices_t({ghost}) && pc.r[ghost] == -7;
+            }
+        }
+        for( int pass = 0; pass < 2; ++pass )
+        {// set messages for particles that are no longer on this rank (a cleared ghost, a particle that migrated):
+         // their values are skipped, the other particles are updated. Pass 0: array_major with half precision and
+         // delta encoding (the second message is xor encoded), pass 1: particle_major.
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            if( pass == 0 ) {
+                hndlr.messageItem(pc.r).setPrecision({half_precision});
+                hndlr.messageItem(pc.m).setDeltaEncoding();
+            } else
+                hndlr.setLayout(particle_major);
+            Indices_t const selection = {2, 4, 6};
+            for( int step = 0; step < 2; ++step )
+            {
+                pc.r[4] = 1.5f + step;
+                pc.m[4] = 2.5f + step;
+                PcMessageData md(mpi::rank, mpi::rank, 0, selection, set);
+                hndlr.messageItemList().computeMessageBufferSize(&md);
+                md.allocateBuffer();
+                hndlr.messageItemList().write(&md);
+                pc.r[4] = pc.m[4] = -1;
+                if( step == 1 ) {// 2 and 6 migrate, and come back as ghosts, which are cleared before the update arrives
+                    Id_t const id2 = pc.id(2), id6 = pc.id(6);
+                    pc.remove(2);
+                    pc.remove(6);
+                    pc.addGhosts({id2, id6});
+                    pc.clearGhosts();
+                }
+                md.indices().clear();
+                hndlr.messageItemList().read(&md);
+                ok = ok && pc.r[4] == 1.5f + step && pc.m[4] == 2.5f + step;
+                if( step == 1 )
+                    ok = ok && md.indices() == Indices_t({-1, 4, -1}) && md.nMissing() == 2 && pc.nAlive() == 6;
+            }
+        }
+        {// reorder() sorts the owned particles only
+            ParticleContainer pc(64, "PC");
+            pc.addGhosts({Id_t(1) << 50});
+            pc.r[64] = -1;
+            std::vector<uint64_t> keys(pc.capacity());
+            for( size_t i = 0; i < keys.size(); ++i ) keys[i] = keys.size() - i;
+            real_t r0 = pc.r[0];
+            Indices_t remap = pc.reorder(keys);
+            ok = ok && remap[0] == 63 && pc.r[63] == r0 && remap[64] == 64 && pc.r[64] == -1;
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_Handles()
+    {// Handles follow their particles through compaction, reordering, growth and ghost clearing, and are
+     // invalidated when their particle is removed, even if the slot is reused.
+        init();
+        prdbg("-*# test_Handles() #*-");
+        bool ok = true;
+        {
+            ParticleContainer pc(100, "PC");
+            std::vector<ParticleHandle> h = pc.handles(Indices_t({10, 50, 99}));
+            ok = ok && pc.nHandles() == 3 && pc.handle(50) == h[1] && pc.nHandles() == 3
+                    && pc.indices(h) == Indices_t({10, 50, 99}) && pc.index(ParticleHandle()) == -1;
+            Id_t const id99 = pc.id(99);
+         // compaction moves particle 98 into the hole at 3 and particle 99 into the hole at 50
+            pc.remove(3);
+            pc.remove(50);
+            ok = ok && pc.index(h[1]) == -1 && pc.nHandles() == 2;
+            pc.compact();
+            ok = ok && pc.index(h[0]) == 10 && pc.index(h[2]) == 50 && pc.id(pc.index(h[2])) == id99;
+         // a reused slot has a new generation: the old handle remains invalid
+            Index_t i = pc.add();
+            ParticleHandle hNew = pc.handle(i);
+            ok = ok && hNew.slot == h[1].slot && hNew != h[1] && pc.index(h[1]) == -1 && pc.index(hNew) == i;
+         // reordering
+            std::vector<uint64_t> keys(pc.capacity());
+            for( size_t k = 0; k < keys.size(); ++k ) keys[k] = keys.size() - k;
+            Indices_t remap = pc.reorder(keys);
+            ok = ok && pc.index(h[0]) == remap[10] && pc.id(pc.index(h[2])) == id99 && pc.index(hNew) == remap[i];
+         // ghosts: growing the owned region moves them, clearing them invalidates their handles
+            Index_t ghost = pc.addGhosts({Id_t(1) << 50})[0];
+            ParticleHandle hGhost = pc.handle(ghost);
+            pc.addN(200);
+            ok = ok && pc.index(hGhost) == pc.ghostBegin() && pc.id(pc.index(hGhost)) == Id_t(1) << 50;
+            pc.clearGhosts();
+            ok = ok && pc.index(hGhost) == -1 && pc.nHandles() == 3;
+         // new particles in reused slots have no handle yet
+            pc.remove(pc.index(h[0]));
+            pc.compact(true);
+            ok = ok && pc.nHandles() == 2 && pc.id(pc.index(h[2])) == id99;
+            i = pc.add();
+            ok = ok && pc.nHandles() == 2 && pc.handle(i).slot == h[0].slot && pc.nHandles() == 3;
+        }
+        {// a particle that is moved to another rank (here: the same rank) loses its handle
+            ParticleContainer pc(8, "PC");
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            ParticleHandle h = pc.handle(2);
+            PcMessageData md(mpi::rank, mpi::rank, 0, Indices_t({2}), move);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            hndlr.messageItemList().read(&md);
+            ok = ok && pc.index(h) == -1 && pc.is_alive(md.indices()[0]) && pc.nHandles() == 0;
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_LargeIndices()
+    {// Indices beyond 2^31 and 2^32. The index arithmetic is always tested. The container with more than 2^31
+     // particles is only created on request (environment variable MPICTS_TEST_LARGE=1), on rank 0 only, and if
+     // the node has the memory available for it, see below.
+        init();
+        prdbg("-*# test_LargeIndices() #*-");
+        bool ok = true;
+        {// growth
+            ok = ok && ParticleContainer::grownCapacity(size_t(3) << 30, 1) == size_t(9) << 29
+                    && ParticleContainer::grownCapacity(size_t(1) << 31, size_t(1) << 32) == size_t(3) << 31;
+        }
+        {// the ID map and the index coding of the messages
+            Index_t const big = (Index_t(1) << 32) + 7;
+            IdMap map;
+            map.insert(42, big);
+            map.insert(43, big - (Index_t(1) << 31));
+            ok = ok && map.find(42) == big && map.find(43) == big - (Index_t(1) << 31);
+            for( Indices_t const& indices : { Indices_t({big, big + 1, big + 2, big + 3})
+                                            , Indices_t({3, big, Index_t(1) << 40, big + 1000})
+                                            , Indices_t({Index_t(1) << 31, (Index_t(1) << 31) + 64}) } ) {
+                std::vector<char> buffer( index_coding::encodedSize(indices) );
+                void* pos = buffer.data();
+                index_coding::encode(indices, pos);
+                ok = ok && pos == buffer.data() + buffer.size();
+                Indices_t decoded;
+                pos = buffer.data();
+                index_coding::decode(pos, indices.size(), decoded);
+                ok = ok && decoded == indices;
+            }
+        }
+        size_t const n = (size_t(1) << 31) + 100;
+     // The footprint per particle: the ID map has 2^33 slots of 16 bytes (64 bytes per particle), the IDs, r, m
+     // and the handle slots take 20 bytes, and grow() needs another 20 or so (the reallocation of r and m, the
+     // free list). Ask for 128 bytes per particle.
+        char const* large = getenv("MPICTS_TEST_LARGE");
+        if( large && atoi(large) && mpi::rank == 0
+         && size_t(sysconf(_SC_AVPHYS_PAGES))*size_t(sysconf(_SC_PAGE_SIZE)) > 128*n )
+        {
+            ParticleContainer pc(n, "PC");
+            Index_t const last = n - 1;
+            ok = ok && pc.is_alive(last) && pc.index(pc.id(last)) == last && pc.countAlive(0, n) == n;
+            pc.remove(last);
+            ok = ok && !pc.is_alive(last) && pc.nAlive() == n - 1 && pc.add() == last;
+         // a set message for particles on both sides of 2^31
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+            Indices_t const indices = {5, Index_t(1) << 31, last};
+            for( auto i : indices ) pc.r[i] = -real_t(i % 1000);
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            for( auto i : indices ) pc.r[i] = 0;
+            hndlr.messageItemList().read(&md);
+            ok = ok && md.indices() == indices;
+            for( auto i : indices ) ok = ok && pc.r[i] == -real_t(i % 1000);
+         // growth beyond 2^31
+            ok = ok && pc.grow() == Index_t(n) && pc.capacity() == n + n/2 && pc.add() == Index_t(n);
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_PagedArray()
+    {// Paged storage: elements do not move when the array grows, and messages are the same as for a std::vector.
+        init();
+        prdbg("-*# test_PagedArray() #*-");
+        bool ok = true;
+        {
+            PagedArray<int, 64> a(10); // 16 ints per page
+            ok = ok && PagedArray<int, 64>::pageSize == 16 && a.nPages() == 1 && a.size() == 10 && a[9] == 0;
+            for( int i = 0; i < 10; ++i ) a[i] = i;
+            int* p = &a[3];
+            a.resize(1000);
+            ok = ok && &a[3] == p && a[3] == 3 && a[999] == 0 && a.nPages() == 63;
+            bool spansOk = true;
+            size_t nVisited = 0;
+            a.forEachPage( [&](int* span, size_t n, size_t first) {
+                spansOk = spansOk && (uintptr_t(span) % 64 == 0 || first % 16) && n <= 16 && span == &a[first];
+                nVisited += n;
+            }, 5, 1000 );
+            ok = ok && spansOk && nVisited == 995;
+         // shrinking resets the elements, growing again value initializes them
+            a.resize(5);
+            a.resize(20);
+            ok = ok && a[4] == 4 && a[5] == 0 && a[19] == 0;
+            a.shrink_to_fit();
+            ok = ok && a.capacity() == 32;
+            int sum = 0;
+            for( int v : a ) sum += v;
+            ok = ok && sum == 0 + 1 + 2 + 3 + 4;
+        }
+        {// write_n and read_n write the same bytes as for a std::vector, for runs and isolated indices across pages
+            size_t const n = 300;
+            std::vector<float> v(n);
+            PagedArray<float, 64> pa(n);
+            std::vector<std::vector<int>> vv(n);
+            PagedArray<std::vector<int>, 64> pvv(n);
+            for( size_t i = 0; i < n; ++i ) {
+                v[i] = pa[i] = 0.5f*i;
+                vv[i] = pvv[i] = std::vector<int>(i%3, int(i));
+            }
+            Indices_t indices;
+            for( Index_t i = 0; i < Index_t(n); i += i%7 + 1 ) indices.push_back(i);
+            for( Index_t i = 100; i < 140; ++i ) indices.push_back(i);
+            for( Index_t i : {299, 0, 17, 16, 15, 250} ) indices.push_back(i);
+            {
+                std::vector<char> b0( computeBufferSize_n(v, indices) ), b1( computeBufferSize_n(pa, indices) );
+                void* p0 = b0.data();
+                void* p1 = b1.data();
+                write_n(v, indices, p0);
+                write_n(pa, indices, p1);
+                ok = ok && b0.size() == b1.size() && p1 == b1.data() + b1.size() && b0 == b1;
+                PagedArray<float, 64> copy(n);
+                p1 = b1.data();
+                read_n(copy, indices, p1);
+                for( auto i : indices ) ok = ok && copy[i] == pa[i];
+                ok = ok && copy[2] == 0 && p1 == b1.data() + b1.size(); // 2 is not selected
+            }
+            {
+                std::vector<char> b0( computeBufferSize_n(vv, indices) ), b1( computeBufferSize_n(pvv, indices) );
+                void* p0 = b0.data();
+                void* p1 = b1.data();
+                write_n(vv, indices, p0);
+                write_n(pvv, indices, p1);
+                ok = ok && b0.size() == b1.size() && b0 == b1;
+                PagedArray<std::vector<int>, 64> copy(n);
+                p1 = b1.data();
+                read_n(copy, indices, p1);
+                for( auto i : indices ) ok = ok && copy[i] == pvv[i];
+            }
+        }
+        {// a PagedParticleArray in a ParticleContainer
+            ParticleContainer pc(100, "PC");
+            PagedParticleArray<real_t> q("q", pc);
+            for( Index_t i = 0; i < 100; ++i ) q[i] = i;
+            real_t* p0 = &q[0];
+            pc.grow(1000);
+            ok = ok && &q[0] == p0 && q.size() == pc.capacity() && q[99] == 99 && q[1099] == 0;
+         // compaction moves its elements with those of the other arrays
+            for( Index_t i = 0; i < 100; i += 3 ) pc.remove(i);
+            pc.addN(10);
+            pc.remove(5);
+            Indices_t remap = pc.compact();
+            for( Index_t i = 0; i < 100; ++i )
+                if( remap[i] >= 0 ) ok = ok && q[remap[i]] == i;
+         // messages: particle_major layout falls back to array_major
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc); // r, m and q
+            hndlr.setLayout(particle_major);
+            Indices_t indices = {1, 2, 4};
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            hndlr.messageItemList().read(&md);
+            ok = ok && md.layout() == array_major;
+            for( size_t k = 0; k < indices.size(); ++k )
+                ok = ok && q[md.indices()[k]] == q[indices[k]] && pc.r[md.indices()[k]] == pc.r[indices[k]];
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_MemoryPolicy()
+    {// Allocation according to a MemoryPolicy, and ParticleArrays that use it.
+        init();
+        prdbg("-*# test_MemoryPolicy() #*-");
+        bool ok = true;
+        ok = ok && nNumaNodes() >= 1;
+        for( MemoryPolicy const& policy : {MemoryPolicy(), MemoryPolicy::huge(), MemoryPolicy::firstTouch(4), MemoryPolicy::node(0)} )
+        {
+            size_t const nBytes = 3*hugePageSize/2 + 5;
+            void* p = allocateMemory(nBytes, policy);
+            ok = ok && p && uintptr_t(p) % (policy.hugePages ? hugePageSize : 4096) == 0;
+            std::memset(p, 1, nBytes);
+            deallocateMemory(p, nBytes, policy);
+            ok = ok && allocateMemory(0, policy) == nullptr;
+        }
+        for( int node : {nNumaNodes(), 64, 1000} )
+        {// nodes that do not exist
+            try {
+                allocateMemory(64, MemoryPolicy::node(node));
+                ok = false;
+            } catch( std::invalid_argument const& ) {}
+        }
+        {// a PolicyParticleArray keeps its policy when the container grows, and is contiguous
+            ParticleContainer pc(100, "PC");
+            PolicyParticleArray<real_t> a("a", pc, MemoryPolicy::node(0));
+            for( Index_t i = 0; i < 100; ++i ) a[i] = i;
+            pc.grow(1000);
+            ok = ok && a.size() == pc.capacity() && a[99] == 99 && a[1000] == 0
+                    && a.get_allocator().policy() == MemoryPolicy::node(0) && uintptr_t(a.data()) % 4096 == 0;
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc); // r, m and a
+            hndlr.setLayout(particle_major);
+            Indices_t indices = {1, 2, 4};
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            hndlr.messageItemList().read(&md);
+            ok = ok && md.layout() == particle_major;
+            for( size_t k = 0; k < indices.size(); ++k )
+                ok = ok && a[md.indices()[k]] == a[indices[k]];
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool test_MessageView()
+    {// View messages written on the same rank, and, if there are at least 2 MPI processes, received ones.
+        init();
+        prdbg("-*# test_MessageView() #*-");
+        bool ok = true;
+        {
+            double a = 1.5; std::vector<float> v = {1,2,3}; std::vector<std::vector<int>> nested = {{1},{2,3}}; int i = 7;
+            MessageHandler::create(); // makes sure MessageHeader::theHeaders is initialized.
+            MessageItemList list;
+            list.push_back(a); list.push_back(v); list.push_back(nested); list.push_back(i);
+            MessageData md(mpi::rank, mpi::rank, 0);
+            list.computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            list.write(&md);
+            void* ptr = md.bufferPtr();
+
+            MessageView view(list, &md);
+            ok = ok && md.bufferPtr() == nullptr && view.buffer().ptr() == ptr // the buffer was moved into the view
+                    && view.size() == 4
+                    && view.span<double>(0)[0] == a
+                    && view.span<float>(1).size() == 3 && view.span<float>(1)[2] == 3
+                    && !view.available(2)
+                    && view.span<int>(3)[0] == i;
+        }
+#ifdef PC
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        ParticleArray<std::vector<Index_t>> bonds("bonds", pc);
+        for( Index_t i = 0; i < (Index_t)pc.size(); ++i )
+            for( Index_t j = 0; j < i%4; ++j )
+                bonds[i].push_back(10*i + j);
+        hndlr.addParticleArray(bonds);
+        Indices_t indices = {1,4,6,3};
+        {// set mode, array_major
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr.messageItemList().write(&md);
+            MessageView view(hndlr.messageItemList(), &md);
+            Span<Index_t> selection = view.span<Index_t>(0);
+            Span<real_t> r = view.span<real_t>(1);
+            Span<size_t> ends = view.ends(3);
+            Span<Index_t> partners = view.span<Index_t>(3);
+            ok = ok && selection.size() == indices.size() && r.contiguous() && partners.size() == 6
+                    && md.indices() == indices; // translated from the IDs
+            size_t begin = 0;
+            for( size_t j = 0; j < indices.size(); ++j ) {
+                ok = ok && selection[j] == pc.id(indices[j]) && r[j] == pc.r[indices[j]];
+                for( size_t k = begin; k < ends[j]; ++k )
+                    ok = ok && partners[k] == bonds[indices[j]][k - begin];
+                begin = ends[j];
+            }
+        }
+        ParticleContainer pc2(8, "PC2");
+        PcMessageHandler& hndlr2 = PcMessageHandler::create(pc2);
+        for( Index_t i = 0; i < (Index_t)pc2.size(); ++i ) pc2.m[i] = 2*i;
+        {// copy mode, particle_major: the values are interleaved
+            hndlr2.setLayout(particle_major);
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            hndlr2.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr2.messageItemList().write(&md);
+            MessageView view(hndlr2.messageItemList(), &md);
+            Span<real_t> m = view.span<real_t>(2);
+            Span<Id_t> ids = view.span<Id_t>(0);
+            ok = ok && ids.size() == indices.size() && !m.contiguous()
+                    && md.indices() == Indices_t(indices.size(), -1);
+            for( size_t j = 0; j < indices.size(); ++j )
+                ok = ok && ids[j] == pc2.id(indices[j]) && m[j] == pc2.m[indices[j]];
+        }
+        {// copy mode, aligned: the values can be used in place
+            hndlr2.setLayout(array_major);
+            hndlr2.messageItemList().setAlignment(64);
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, copy);
+            hndlr2.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            hndlr2.messageItemList().write(&md);
+            MessageView view(hndlr2.messageItemList(), &md);
+            Span<real_t> m = view.span<real_t>(2);
+            ok = ok && m.contiguous() && m.aligned() && (uintptr_t)m.data() % 64 == 0;
+            Eigen::Map<Eigen::Matrix<real_t,4,1> const, Eigen::Aligned64> mMap(m.data());
+            for( size_t j = 0; j < indices.size(); ++j )
+                ok = ok && mMap[j] == pc2.m[indices[j]];
+        }
+#endif
+        if( mpi::size >= 2 )
+        {// rank 0 sends a message to rank 1, which views it.
+            double a = 5;
+            std::vector<int> ints = {1,2,3,4};
+            MessageHandler& hndlr3 = MessageHandler::create();
+            hndlr3.messageItemList().push_back(a);
+            hndlr3.messageItemList().push_back(ints);
+            if( mpi::rank == 0 ) hndlr3.addSendMessage(1);
+            MessageHeader::broadcastMessageHeaders();
+            hndlr3.sendMessages();
+            std::vector<MessageView> views = hndlr3.recvMessageViews();
+            if( mpi::rank == 1 ) {
+                ok = ok && views.size() == 1 && views[0].src() == 0
+                        && views[0].span<double>(0)[0] == 5
+                        && views[0].span<int>(1).size() == 4 && views[0].span<int>(1)[3] == 4;
+            } else
+                ok = ok && views.empty();
+        }
+        finalize();
+        return ok;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool test_VariableLength()
+    {// Send a ParticleArray of bond partner lists in set mode to the same rank, without MPI communication
+        init();
+        prdbg("-*# test_VariableLength() #*-");
+        bool ok = true;
+
+        ParticleContainer pc(8, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+        ParticleArray<std::vector<Index_t>> bonds("bonds", pc);
+        for( Index_t i = 0; i < (Index_t)pc.size(); ++i )
+            for( Index_t j = 0; j < i%4; ++j )
+                bonds[i].push_back(10*i + j);
+        hndlr.addParticleArray(bonds);
+
+        Indices_t indices = {1,4,6,3}; // 1, 0, 2 and 3 bonds
+        {// the selected elements: the table of cumulative sizes and the values
+            std::vector<Index_t> expected = {1, 1, 3, 6, 10, 60, 61, 30, 31, 32};
+            ok = ok && computeBufferSize_n(bonds, indices) == expected.size()*sizeof(Index_t);
+            std::vector<Index_t> buffer(expected.size());
+            void* pos = buffer.data();
+            write_n(bonds, indices, pos);
+            ok = ok && pos == buffer.data() + buffer.size() && buffer == expected;
+        }
+        {// round trip
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            size_t sz = hndlr.messageItemList().computeMessageBufferSize(&md);
+            ok = ok && sz == sizeof(size_t) + sizeof(Mode) + sizeof(Layout) + index_coding::encodedSize(pc.ids(indices))
+                           + 2*(sizeof(Precision) + sizeof(delta::Method) + 4*sizeof(real_t))    // r and m
+                           + sizeof(Precision) + sizeof(delta::Method) + (4 + 6)*sizeof(Index_t); // bonds
+            md.allocateBuffer();
+            ok = ok && hndlr.messageItemList().write(&md) == sz;
+            ParticleArray<std::vector<Index_t>> original(bonds);
+            for( auto i : indices ) bonds[i] = {-1, -1, -1, -1, -1};
+            hndlr.messageItemList().read(&md);
+            for( Index_t i = 0; i < (Index_t)pc.size(); ++i )
+                ok = ok && bonds[i] == original[i];
+        }
+        {// nested containers
+            std::vector<std::vector<std::string>> a = {{"a","bc"}, {}, {"", "def", "g"}};
+            Indices_t selection = {2, 0};
+            size_t nBytes = computeBufferSize_n(a, selection);
+            ok = ok && nBytes == 2*sizeof(size_t) + 5*sizeof(size_t) + 7;
+            std::vector<char> buffer(nBytes);
+            void* pos = buffer.data();
+            write_n(a, selection, pos);
+            ok = ok && pos == buffer.data() + nBytes;
+            std::vector<std::vector<std::string>> b(3);
+            pos = buffer.data();
+            read_n(b, selection, pos);
+            ok = ok && pos == buffer.data() + nBytes && b[0] == a[0] && b[1].empty() && b[2] == a[2];
+        }
+        finalize();
+        return ok;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+}
+
+namespace bench
+{//---------------------------------------------------------------------------------------------------------------------
+ // Benchmarks. These are not run by the tests. mpi::_debug_ must be false, or the timings will be dominated by
+ // the debug output. (Tracing at level trace::info or lower does not affect the timings significantly.)
+ //---------------------------------------------------------------------------------------------------------------------
+    template<typename F>
+    double // time per call in nanoseconds
+    time_it(F f, int nRepetitions)
+    {
+        using namespace std::chrono;
+        auto t0 = high_resolution_clock::now();
+        for( int r = 0; r < nRepetitions; ++r ) f();
+        auto t1 = high_resolution_clock::now();
+        return duration_cast<nanoseconds>(t1 - t0).count() / double(nRepetitions);
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    bool bench_StaticMessage()
+    {// Compare writing and reading a message composed of a few small items with a MessageItemList
+     // and with a StaticMessage.
+        init();
+        int const nRepetitions = 100000;
+        {
+            double a = 1; int i = 2; float f = 3; Index_t j = 4; vec_t v(5,6,7);
+            MessageHandler::create(); // makes sure MessageHeader::theHeaders is initialized.
+
+            MessageItemList list;
+            list.push_back(a); list.push_back(i); list.push_back(f); list.push_back(j); list.push_back(v);
+            MessageData md0(mpi::rank, mpi::rank, 0);
+            list.computeMessageBufferSize(&md0);
+            md0.allocateBuffer();
+
+            StaticMessage<double,int,float,Index_t,vec_t> msg(a, i, f, j, v);
+            MessageData md1(mpi::rank, mpi::rank, 0);
+            msg.computeMessageBufferSize(&md1);
+            md1.allocateBuffer();
+
+            double t_list_size  = time_it([&]{ list.computeMessageBufferSize(&md0); }, nRepetitions);
+            double t_list_write = time_it([&]{ list.write(&md0); }, nRepetitions);
+            double t_list_read  = time_it([&]{ list.read (&md0); }, nRepetitions);
+            double t_msg_size   = time_it([&]{ msg .computeMessageBufferSize(&md1); }, nRepetitions);
+            double t_msg_write  = time_it([&]{ msg .write(&md1); }, nRepetitions);
+            double t_msg_read   = time_it([&]{ msg .read (&md1); }, nRepetitions);
+
+            std::cout<<"bench_StaticMessage (5 items, "<<md1.size()<<" bytes, ns per message):"
+                     <<"\n                   size   write    read"
+                     <<"\n  MessageItemList "<<std::setw(7)<<t_list_size<<' '<<std::setw(7)<<t_list_write<<' '<<std::setw(7)<<t_list_read
+                     <<"\n  StaticMessage   "<<std::setw(7)<<t_msg_size <<' '<<std::setw(7)<<t_msg_write <<' '<<std::setw(7)<<t_msg_read
+                     <<std::endl;
+        }
+        finalize();
+        return true;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+    bool bench_BulkTransfer()
+    {// Compare writing and reading selected array elements one by one with ::mpi::write/read, and in bulk with
+     // write_n/read_n, for several selections.
+        init();
+        size_t const n = 1000000;
+        int const nRepetitions = 20;
+        std::vector<float> a(n);
+        for( size_t i = 0; i < n; ++i ) a[i] = i;
+
+        std::vector<std::pair<std::string,Indices_t>> selections(3);
+        selections[0].first = "contiguous";
+        for( size_t i = 0; i < n/2; ++i ) selections[0].second.push_back(n/4 + i);
+        selections[1].first = "every 3rd";
+        for( size_t i = 0; i < n; i += 3 ) selections[1].second.push_back(i);
+        selections[2].first = "random 10%";
+        for( size_t i = 0; i < n/10; ++i ) selections[2].second.push_back( (i*2654435761u) % n );
+
+        std::cout<<"bench_BulkTransfer (float, ns per element):"
+                 <<"\n                 loop write  loop read   write_n    read_n";
+        for( auto const& selection : selections )
+        {
+            Indices_t const& indices = selection.second;
+            std::vector<char> buffer(indices.size()*sizeof(float));
+            double t_loop_write = time_it([&]{ void* pos = buffer.data(); for( auto i : indices ) ::mpi::write(a[i], pos); }, nRepetitions);
+            double t_loop_read  = time_it([&]{ void* pos = buffer.data(); for( auto i : indices ) ::mpi::read (a[i], pos); }, nRepetitions);
+            double t_write_n    = time_it([&]{ void* pos = buffer.data(); write_n(a, indices, pos); }, nRepetitions);
+            double t_read_n     = time_it([&]{ void* pos = buffer.data(); read_n (a, indices, pos); }, nRepetitions);
+            double m = 1.0/indices.size();
+            std::cout<<"\n  "<<std::setw(12)<<selection.first
+                     <<' '<<std::setw(10)<<t_loop_write*m<<' '<<std::setw(10)<<t_loop_read*m
+                     <<' '<<std::setw(10)<<t_write_n*m   <<' '<<std::setw(10)<<t_read_n*m;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_AliveMask()
+    {// Compare loops over the live particles: testing is_alive(i) for every particle, iterating over the alive mask
+     // a word at a time, and selecting the live particles first.
+        init();
+        int const nParticles = 10000000;
+        int const nRepetitions = 5;
+        std::cout<<"bench_AliveMask (sum of m over the live particles, ns per particle):"
+                 <<"\n  alive  is_alive    alive()   select()";
+        for( double fraction : {0.1, 0.5, 0.9} )
+        {
+            ParticleContainer pc(nParticles, "PC");
+            for( Index_t i = 0; i < nParticles; ++i )
+                if( (i*2654435761u) % 1000 >= fraction*1000 ) pc.remove(i);
+            double sum[3] = {0, 0, 0}, t[3];
+            t[0] = time_it([&]{ for( Index_t i = 0; i < nParticles; ++i ) if( pc.is_alive(i) ) sum[0] += pc.m[i]; }, nRepetitions);
+            t[1] = time_it([&]{ for( Index_t i : pc.alive() ) sum[1] += pc.m[i]; }, nRepetitions);
+            t[2] = time_it([&]{ for( Index_t i : pc.select() ) sum[2] += pc.m[i]; }, nRepetitions);
+            assert( sum[0] == sum[1] && sum[0] == sum[2] );
+            std::cout<<"\n  "<<std::setw(5)<<fraction;
+            for( int k = 0; k < 3; ++k )
+                std::cout<<' '<<std::setw(10)<<t[k]/nParticles;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Layout()
+    {// Compare the array_major and particle_major layout of ParticleContainer messages in set mode, for several
+     // numbers of arrays and selection densities.
+        init();
+        int const nParticles = 1000000;
+        int const nRepetitions = 10;
+        ParticleContainer pc(nParticles, "PC");
+        PcMessageHandler& hndlr = PcMessageHandler::create(pc); // has arrays r and m
+        std::vector<ParticleArray<float>*> extraArrays;
+        std::cout<<"bench_Layout (float arrays, set mode, write + read, ns per particle):"
+                 <<"\n  arrays  density  array_major  particle_major";
+        for( int nArrays : {2, 4, 8, 16} )
+        {
+            while( 2 + extraArrays.size() < size_t(nArrays) ) {
+                extraArrays.push_back( new ParticleArray<float>(concatenate("a", extraArrays.size()), pc) );
+                std::fill(extraArrays.back()->begin(), extraArrays.back()->end(), float(extraArrays.size()));
+                hndlr.addParticleArray(*extraArrays.back());
+            }
+            for( double density : {0.01, 0.1, 0.5, 1.0} )
+            {
+                Indices_t indices;
+                for( int i = 0; i < nParticles; ++i )
+                    if( (i*2654435761u) % 1000 < density*1000 ) indices.push_back(i);
+                double t[2];
+                for( Layout layout : {array_major, particle_major} ) {
+                    hndlr.setLayout(layout);
+                    PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+                    hndlr.messageItemList().computeMessageBufferSize(&md);
+                    md.allocateBuffer();
+                    t[layout] = time_it([&]{ hndlr.messageItemList().write(&md); hndlr.messageItemList().read(&md); }
+                                       , nRepetitions) / indices.size();
+                }
+                std::cout<<"\n  "<<std::setw(6)<<nArrays<<' '<<std::setw(8)<<density
+                         <<' '<<std::setw(12)<<t[array_major]<<' '<<std::setw(15)<<t[particle_major];
+            }
+        }
+        std::cout<<std::endl;
+        for( auto pArray : extraArrays ) delete pArray;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+    bool bench_IdMap()
+    {// ID to index lookups in random order, one at a time and batched, against std::unordered_map.
+        init();
+        int const nRepetitions = 5;
+        std::cout<<"bench_IdMap (ns per lookup):"
+                 <<"\n       ids  unordered_map  find(id)  find(ids)";
+        for( int nIds : {10000, 1000000, 10000000} )
+        {
+            IdMap map;
+            std::unordered_map<Id_t, Index_t> umap;
+            map.reserve(nIds);
+            umap.reserve(nIds);
+            for( Id_t id = 0; id < nIds; ++id ) {
+                map.insert(id, nIds - id);
+                umap[id] = nIds - id;
+            }
+            std::vector<Id_t> ids(nIds);
+            for( int k = 0; k < nIds; ++k ) ids[k] = (k*2654435761u) % nIds;
+            Indices_t indices(nIds);
+            double t[3];
+            t[0] = time_it([&]{ for( int k = 0; k < nIds; ++k ) indices[k] = umap.find(ids[k])->second; }, nRepetitions);
+            t[1] = time_it([&]{ for( int k = 0; k < nIds; ++k ) indices[k] = map.find(ids[k]); }, nRepetitions);
+            t[2] = time_it([&]{ map.find(ids.data(), ids.size(), indices.data()); }, nRepetitions);
+            std::cout<<"\n  "<<std::setw(8)<<nIds;
+            for( int k = 0; k < 3; ++k )
+                std::cout<<' '<<std::setw(k ? 10 : 14)<<t[k]/nIds;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Reorder()
+    {// Pack and unpack a boundary layer (set mode) of particles at random positions, before and after
+     // reordering them along a space filling curve.
+        init();
+        int const nParticles = 1 << 20;
+        int const nRepetitions = 10;
+        std::cout<<"bench_Reorder (boundary layer of 1/32 of the particles, set mode, write + read):"
+                 <<"\n  order     runs  reorder (ms)  ns per particle";
+        for( int order = 0; order < 3; ++order )
+        {
+            ParticleContainer pc(nParticles, "PC");
+            ParticleArray<vec_t> x("x", pc);
+            uint64_t seed = 1;
+            for( auto& xi : x )
+                for( int k = 0; k < 3; ++k ) {
+                    seed = seed*6364136223846793005ull + 1442695040888963407ull;
+                    xi[k] = float(seed >> 40)/float(1 << 24);
+                }
+            PcMessageHandler& hndlr = PcMessageHandler::create(pc); // r, m and x
+            double tReorder = 0;
+            if( order ) {
+                sfc::Curve curve = order == 1 ? sfc::morton : sfc::hilbert;
+                std::vector<uint64_t> keys(pc.size());
+                tReorder = time_it([&]{
+                    for( Index_t i = 0; i < nParticles; ++i )
+                        keys[i] = sfc::key(curve, sfc::quantize(x[i][0], 0, 1), sfc::quantize(x[i][1], 0, 1)
+                                                , sfc::quantize(x[i][2], 0, 1));
+                    pc.reorder(keys);
+                }, 1);
+            }
+            Indices_t indices;
+            size_t runs = 0;
+            for( Index_t i = 0; i < nParticles; ++i )
+                if( x[i][0] < 1.0f/32 ) {
+                    if( indices.empty() || indices.back() != i - 1 ) ++runs;
+                    indices.push_back(i);
+                }
+            PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+            hndlr.messageItemList().computeMessageBufferSize(&md);
+            md.allocateBuffer();
+            double t = time_it([&]{ hndlr.messageItemList().write(&md); hndlr.messageItemList().read(&md); }
+                              , nRepetitions);
+            std::cout<<"\n  "<<std::setw(7)<<(order ? sfc::str(order == 1 ? sfc::morton : sfc::hilbert) : "random")
+                     <<' '<<std::setw(8)<<runs<<' '<<std::setw(13)<<tReorder*1e-6<<' '<<std::setw(16)<<t/indices.size();
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Ghosts()
+    {// Receive, update and purge a layer of ghosts in a fragmented container: ghosts mixed into the owned
+     // slots (taken from the free list, purged by a scan of the whole container) against the ghost region.
+        init();
+        int const nParticles = 1 << 20;
+        int const nRepetitions = 10;
+        std::cout<<"bench_Ghosts (add, set r, purge, ns per ghost):"
+                 <<"\n  ghosts     mixed  ghost region";
+        for( int nGhosts : {1 << 12, 1 << 16} )
+        {
+            std::vector<Id_t> ids(nGhosts);
+            for( int k = 0; k < nGhosts; ++k ) ids[k] = (Id_t(1) << 50) + k;
+            double t[2];
+            {
+                ParticleContainer pc(nParticles, "PC");
+                ParticleArray<char> isGhost("isGhost", pc);
+                isGhost.assign(nParticles, 0);
+                for( Index_t i = 0; i < nParticles; ++i )
+                    if( (i*2654435761u) % 1000 < 100 ) pc.remove(i);
+                pc.reserve(nGhosts); // not timed
+                t[0] = time_it([&]{
+                    Indices_t indices = pc.addN(ids);
+                    for( auto i : indices ) {
+                        pc.r[i] = 1;
+                        isGhost[i] = 1;
+                    }
+                    for( Index_t i = 0; i < Index_t(pc.capacity()); ++i )
+                        if( isGhost[i] ) {
+                            isGhost[i] = 0;
+                            pc.remove(i);
+                        }
+                }, nRepetitions);
+            }
+            {
+                ParticleContainer pc(nParticles, "PC");
+                for( Index_t i = 0; i < nParticles; ++i )
+                    if( (i*2654435761u) % 1000 < 100 ) pc.remove(i);
+                pc.reserveGhosts(nGhosts);
+                t[1] = time_it([&]{
+                    Indices_t indices = pc.addGhosts(ids);
+                    for( auto i : indices ) pc.r[i] = 1;
+                    pc.clearGhosts();
+                }, nRepetitions);
+            }
+            std::cout<<"\n  "<<std::setw(6)<<nGhosts<<' '<<std::setw(9)<<t[0]/nGhosts<<' '<<std::setw(13)<<t[1]/nGhosts;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Handles()
+    {// Translate a list of particles held by external code to indices after every reordering: by handle, by ID
+     // (batched), and by rebuilding the list from the old to new index map.
+        init();
+        int const nParticles = 1 << 22;
+        int const nRepetitions = 5;
+        std::cout<<"bench_Handles (ns per particle):"
+                 <<"\n  selected  handles  ids  remap";
+        for( int nSelected : {1 << 12, 1 << 18, 1 << 22} )
+        {
+            ParticleContainer pc(nParticles, "PC");
+            Indices_t selection(nSelected);
+            for( int k = 0; k < nSelected; ++k ) selection[k] = (k*2654435761u) % nParticles;
+            std::vector<ParticleHandle> handles = pc.handles(selection);
+            std::vector<Id_t> ids = pc.ids(selection);
+            std::vector<uint64_t> keys(nParticles);
+            for( int i = 0; i < nParticles; ++i ) keys[i] = (i*0x9E3779B97F4A7C15ull) >> 20;
+            Indices_t remap = pc.reorder(keys);
+            Indices_t indices;
+            double t[3];
+            t[0] = time_it([&]{ indices = pc.indices(handles); }, nRepetitions);
+            t[1] = time_it([&]{ indices = pc.indices(ids); }, nRepetitions);
+            t[2] = time_it([&]{ indices = selection; ParticleContainer::remapIndices(indices, remap); }, nRepetitions);
+            std::cout<<"\n  "<<std::setw(8)<<nSelected;
+            for( int k = 0; k < 3; ++k )
+                std::cout<<' '<<std::setw(k ? 5 : 8)<<t[k]/nSelected;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Indexing()
+    {// The hot loops of the ParticleContainer with 64 bit indices, against the same loops with 32 bit indices.
+        init();
+        int const nParticles = 1 << 24;
+        int const nRepetitions = 5;
+        ParticleContainer pc(nParticles, "PC");
+        for( int i = 0; i < nParticles; i += 3 ) pc.remove(i);
+        std::cout<<"bench_Indexing (ns per particle):"
+                 <<"\n  loop                      int  Index_t";
+        double sum = 0;
+        double t[2];
+        t[0] = time_it([&]{ for( int i = 0; i < nParticles; ++i ) sum += pc.m[i]; }, nRepetitions);
+        t[1] = time_it([&]{ for( Index_t i = 0; i < nParticles; ++i ) sum += pc.m[i]; }, nRepetitions);
+        std::cout<<"\n  sum m             "<<std::setw(9)<<t[0]/nParticles<<' '<<std::setw(8)<<t[1]/nParticles;
+        t[0] = time_it([&]{ for( int i = 0; i < nParticles; ++i ) if( pc.is_alive(i) ) sum += pc.m[i]; }, nRepetitions);
+        t[1] = time_it([&]{ for( Index_t i = 0; i < nParticles; ++i ) if( pc.is_alive(i) ) sum += pc.m[i]; }, nRepetitions);
+        std::cout<<"\n  is_alive, sum m   "<<std::setw(9)<<t[0]/nParticles<<' '<<std::setw(8)<<t[1]/nParticles;
+        std::vector<int> indices32;
+        Indices_t indices64;
+        for( int i = 1; i < nParticles; i += 3 ) {
+            indices32.push_back(i);
+            indices64.push_back(i);
+        }
+        t[0] = time_it([&]{ for( auto i : indices32 ) sum += pc.m[i]; }, nRepetitions);
+        t[1] = time_it([&]{ for( auto i : indices64 ) sum += pc.m[i]; }, nRepetitions);
+        std::cout<<"\n  indirect sum m    "<<std::setw(9)<<t[0]/indices32.size()<<' '<<std::setw(8)<<t[1]/indices64.size();
+        std::cout<<"\n  (checksum "<<sum<<")"<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_PagedArray()
+    {// Growing a ParticleContainer with 8 extra float arrays by 10%, as in a receive, and a copy mode message
+     // of 1/8 of the particles, with contiguous and with paged arrays.
+        init();
+        size_t const nParticles = 1 << 23;
+        int const nRepetitions = 5;
+        std::cout<<"bench_PagedArray:"
+                 <<"\n  storage     grow (ms)  write + read (ns per particle)";
+        Indices_t indices;
+        for( Index_t i = 0; i < Index_t(nParticles); ++i )
+            if( (i*2654435761u) % 8 == 0 ) indices.push_back(i);
+        for( int paged = 0; paged < 2; ++paged )
+        {
+            double tGrow = 0, tMessage = 0;
+            for( int rep = 0; rep < nRepetitions; ++rep )
+            {
+                ParticleContainer pc(nParticles, "PC");
+                std::vector<ParticleArrayBase*> extraArrays;
+                for( int k = 0; k < 8; ++k ) {
+                    std::string name = concatenate("a", k);
+                    if( paged ) extraArrays.push_back( new PagedParticleArray<float>(name, pc) );
+                    else        extraArrays.push_back( new ParticleArray<float>(name, pc) );
+                }
+                tGrow += time_it([&]{ pc.grow(nParticles/10); }, 1);
+                if( rep == 0 ) {
+                    PcMessageHandler& hndlr = PcMessageHandler::create(pc);
+                    PcMessageData md(mpi::rank, mpi::rank, 0, indices, set);
+                    hndlr.messageItemList().computeMessageBufferSize(&md);
+                    md.allocateBuffer();
+                    tMessage = time_it([&]{ hndlr.messageItemList().write(&md); hndlr.messageItemList().read(&md); }
+                                      , nRepetitions);
+                }
+                for( auto pArray : extraArrays ) delete pArray;
+            }
+            std::cout<<"\n  "<<std::setw(10)<<(paged ? "paged" : "vector")<<' '<<std::setw(10)<<tGrow/nRepetitions*1e-6
+                     <<' '<<std::setw(15)<<tMessage/indices.size();
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_MemoryPolicy()
+    {// Pack and unpack (write_n + read_n) 1/8 of the particles of 4 float arrays allocated with different memory
+     // policies: default, huge pages, parallel first touch, and bound to each NUMA node.
+        init();
+        size_t const nParticles = 1 << 24;
+        int const nRepetitions = 5;
+        int const nThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::pair<std::string, MemoryPolicy>> policies =
+            { {"default", MemoryPolicy()}, {"huge pages", MemoryPolicy::huge()}
+            , {concatenate("first touch x", nThreads), MemoryPolicy::firstTouch(nThreads)} };
+        for( int node = 0; node < nNumaNodes(); ++node )
+            policies.push_back( {concatenate("node ", node), MemoryPolicy::node(node)} );
+        Indices_t indices;
+        for( Index_t i = 0; i < Index_t(nParticles); ++i )
+            if( (i*2654435761u) % 8 == 0 ) indices.push_back(i);
+        std::cout<<"bench_MemoryPolicy (4 float arrays, "<<indices.size()<<" of "<<nParticles<<" particles):"
+                 <<"\n  policy               ns per particle   GB/s";
+        for( auto const& policy : policies )
+        {
+            ParticleContainer pc(nParticles, "PC");
+            std::vector<PolicyParticleArray<float>*> arrays;
+            for( int k = 0; k < 4; ++k )
+                arrays.push_back( new PolicyParticleArray<float>(concatenate("a", k), pc, policy.second) );
+            std::vector<float> buffer( 4*indices.size() );
+            double t = time_it([&]{
+                void* pos = buffer.data();
+                for( auto pArray : arrays ) write_n(*pArray, indices, pos);
+                pos = buffer.data();
+                for( auto pArray : arrays ) read_n(*pArray, indices, pos);
+            }, nRepetitions);
+            std::cout<<"\n  "<<std::left<<std::setw(20)<<policy.first<<std::right<<' '<<std::setw(16)<<t/indices.size()
+                     <<' '<<std::setw(6)<<2*4*sizeof(float)*indices.size()/t;
+            for( auto pArray : arrays ) delete pArray;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
+#endif
+ //---------------------------------------------------------------------------------------------------------------------
+#ifdef PC
+    bool bench_Compaction()
+    {// A loop over the live particles of a fragmented container, the compaction, and the same loop over the
+     // dense prefix.
+        init();
+        int const nParticles = 10000000;
+        int const nRepetitions = 5;
+        std::cout<<"bench_Compaction (sum of m over the live particles, ns per live particle):"
+                 <<"\n  alive  fragmented  compact()  compacted";
+        for( double fraction : {0.5, 0.9} )
+        {
+            ParticleContainer pc(nParticles, "PC");
+            for( Index_t i = 0; i < nParticles; ++i )
+                if( (i*2654435761u) % 1000 >= fraction*1000 ) pc.remove(i);
+            Index_t const nAlive = pc.nAlive();
+            double sum[2] = {0, 0}, t[3];
+            t[0] = time_it([&]{ for( Index_t i : pc.alive() ) sum[0] += pc.m[i]; }, nRepetitions);
+            t[1] = time_it([&]{ pc.compact(); }, 1);
+            t[2] = time_it([&]{ for( Index_t i = 0; i < nAlive; ++i ) sum[1] += pc.m[i]; }, nRepetitions);
+            assert( sum[0] == sum[1] );
+            std::cout<<"\n  "<<std::setw(5)<<fraction;
+            for( int k = 0; k < 3; ++k )
+                std::cout<<' '<<std::setw(10)<<t[k]/nAlive;
+        }
+        std::cout<<std::endl;
+        finalize();
+        return true;
+    }
 #endif
  //---------------------------------------------------------------------------------------------------------------------
 }
@@ -141,7 +2268,46 @@ PYBIND11_MODULE(core_dyn, m)
  // m.def("exposed_name", function_pointer, "doc-string for the exposed function");
     m.def("test_MessageHeader"    , &test::test_MessageHeader, "");
     m.def("test_MessageHandler"   , &test::test_MessageHandler, "");
+    m.def("test_StaticMessage"    , &test::test_StaticMessage, "");
+    m.def("test_NestedContainers" , &test::test_NestedContainers, "");
+    m.def("test_PackedFields"     , &test::test_PackedFields, "");
+    m.def("test_Trace"            , &test::test_Trace, "");
+    m.def("test_Codec"            , &test::test_Codec, "");
+    m.def("test_IndexCoding"      , &test::test_IndexCoding, "");
+    m.def("test_BulkTransfer"     , &test::test_BulkTransfer, "");
+    m.def("test_MessageView"      , &test::test_MessageView, "");
+    m.def("test_IdMap"            , &test::test_IdMap, "");
+    m.def("test_Reorder"          , &test::test_Reorder, "");
+
+    m.def("bench_StaticMessage"   , &bench::bench_StaticMessage, "");
+    m.def("bench_BulkTransfer"    , &bench::bench_BulkTransfer, "");
+    m.def("bench_IdMap"           , &bench::bench_IdMap, "");
 #ifdef PC
     m.def("test_PcMessageHandler" , &test::test_PcMessageHandler, "");
+    m.def("test_LossyPrecision"   , &test::test_LossyPrecision, "");
+    m.def("test_DeltaEncoding"    , &test::test_DeltaEncoding, "");
+    m.def("test_ParticleMajor"    , &test::test_ParticleMajor, "");
+    m.def("test_VariableLength"   , &test::test_VariableLength, "");
+    m.def("test_AlignedLayout"    , &test::test_AlignedLayout, "");
+    m.def("test_FreeList"         , &test::test_FreeList, "");
+    m.def("test_AliveMask"        , &test::test_AliveMask, "");
+    m.def("test_Compaction"       , &test::test_Compaction, "");
+    m.def("test_ArraySubsets"     , &test::test_ArraySubsets, "");
+    m.def("test_Reserve"          , &test::test_Reserve, "");
+    m.def("test_GhostRegion"      , &test::test_GhostRegion, "");
+    m.def("test_Handles"          , &test::test_Handles, "");
+    m.def("test_LargeIndices"     , &test::test_LargeIndices, "");
+    m.def("test_PagedArray"       , &test::test_PagedArray, "");
+    m.def("test_MemoryPolicy"     , &test::test_MemoryPolicy, "");
+
+    m.def("bench_Layout"          , &bench::bench_Layout, "");
+    m.def("bench_AliveMask"       , &bench::bench_AliveMask, "");
+    m.def("bench_Compaction"      , &bench::bench_Compaction, "");
+    m.def("bench_Reorder"         , &bench::bench_Reorder, "");
+    m.def("bench_Ghosts"          , &bench::bench_Ghosts, "");
+    m.def("bench_Handles"         , &bench::bench_Handles, "");
+    m.def("bench_Indexing"        , &bench::bench_Indexing, "");
+    m.def("bench_PagedArray"      , &bench::bench_PagedArray, "");
+    m.def("bench_MemoryPolicy"    , &bench::bench_MemoryPolicy, "");
 #endif
 }
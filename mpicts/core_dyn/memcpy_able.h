@@ -2,7 +2,14 @@
 #define MEMCPY_ABLE_H
 
 #include <type_traits>
+#include <array>
+#include <tuple>
+#include <cassert>
+#include <cstring>
 #include <Eigen/Geometry>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#  include <immintrin.h>
+#endif
 
 #include "mpicts.h"
 
@@ -34,7 +41,83 @@ namespace mpi
      // Specializations for vector types
         template<typename T, int N>
         struct fixed_size_memcpy_able<Eigen::Matrix<T,N,1,Eigen::DontAlign>> : std::true_type {};
-     // TODO : Also provide specializations for Vector, Point, Quaternion, ...
+
+        template<typename T>
+        struct fixed_size_memcpy_able<Eigen::Quaternion<T,Eigen::DontAlign>> : std::true_type {};
+     // TODO : Also provide specializations for Point, ...
+
+     // std::array of vector types (std::array<T,N> of trivially copyable T is trivially copyable itself)
+        template<typename T, size_t N>
+        struct fixed_size_memcpy_able<std::array<T,N>> : fixed_size_memcpy_able<T> {};
+
+     //-------------------------------------------------------------------------------------------------
+     // Packed structs: opt-in serialization of small structs without their padding bytes. The fields to
+     // be written are declared with the MPI_PACKED_FIELDS macro (see below). The fields are written back
+     // to back, each with a single memcpy at a fixed (compile time) offset.
+        template<typename T>
+        struct packed_fields
+        {
+            static constexpr bool value = false;
+        };
+
+        template<typename T>
+        struct packed_memcpy_able : std::bool_constant<packed_fields<T>::value> {};
+
+     // The type of a data member, given a pointer to it.
+        template<typename P>
+        struct member_type;
+
+        template<typename C, typename M>
+        struct member_type<M C::*> { using type = M; };
+
+        template<typename P>
+        using member_type_t = typename member_type<P>::type;
+
+     // True if all fields of a tuple of pointers to data members are fixed_size_memcpy_able (checked by
+     // MPI_PACKED_FIELDS: e.g. a std::vector field would otherwise be copied as raw bytes).
+        template<typename Fields>
+        struct packed_fields_fixed_size;
+
+        template<typename... P>
+        struct packed_fields_fixed_size<std::tuple<P...>>
+          : std::bool_constant<(fixed_size_memcpy_able<member_type_t<P>>::value && ...)> {};
+
+     // The number of bytes a packed T occupies in a message: the sum of the sizes of its fields.
+        template<typename T>
+        constexpr size_t
+        packed_size()
+        {
+            return std::apply
+              ( [](auto... field) { return ( sizeof(member_type_t<decltype(field)>) + ... + size_t(0) ); }
+              , packed_fields<T>::fields
+              );
+        }
+
+     // Write the fields of a packed T to dst, and advance dst.
+        template<typename T>
+        void
+        write_packed(T const& t, void*& dst)
+        {
+            std::apply
+              ( [&t, &dst](auto... field) {
+                    ( ( memcpy(dst, &(t.*field), sizeof(t.*field)), advance_void_ptr(dst, sizeof(t.*field)) ), ... );
+                }
+              , packed_fields<T>::fields
+              );
+        }
+
+     // Read the fields of a packed T from src, and advance src.
+        template<typename T>
+        void
+        read_packed(T& t, void*& src)
+        {
+            std::apply
+              ( [&t, &src](auto... field) {
+                    ( ( memcpy(&(t.*field), src, sizeof(t.*field)), advance_void_ptr(src, sizeof(t.*field)) ), ... );
+                }
+              , packed_fields<T>::fields
+              );
+        }
 
      //-------------------------------------------------------------------------------------------------
         template<typename T>
@@ -47,6 +130,161 @@ namespace mpi
         template<>
         struct variable_size_memcpy_able<std::string> : std::true_type {}; // C++17 required
 
+     //-------------------------------------------------------------------------------------------------
+     // Nested containers: containers of variable_size_memcpy_able or nested_memcpy_able objects, e.g.
+     //     std::vector<std::vector<Index_t>>, std::vector<std::string>, std::array<std::vector<float>,3>,
+     //     std::vector<std::vector<std::string>>, ...
+     // A nested container is written level by level. Each level consists of a single table with the
+     // cumulative sizes of all the containers at that level, followed by the next level. The last level
+     // is a single flat data block with all the elements. E.g. {{1,2},{},{3}} is written as
+     //     [3] [2,2,3] [1,2,3]
+     // Thus, the first level is identical to that of a variable_size_memcpy_able object, and each table
+     // and data block is a single contiguous block of memory.
+        template<typename T>
+        struct nested_memcpy_able : std::false_type {};
+     //-------------------------------------------------------------------------------------------------
+     // specializations:
+        template<typename T>
+        struct nested_memcpy_able<std::vector<T>>
+          : std::bool_constant<variable_size_memcpy_able<T>::value || nested_memcpy_able<T>::value> {};
+
+        template<typename T, size_t N>
+        struct nested_memcpy_able<std::array<T,N>>
+          : std::bool_constant<variable_size_memcpy_able<T>::value || nested_memcpy_able<T>::value> {};
+
+     //-------------------------------------------------------------------------------------------------
+     // Machinery for nested_memcpy_able objects.
+     // The containers at a level are represented by a list of pointers to them.
+     //-------------------------------------------------------------------------------------------------
+        template<typename C>
+        void resize_container(C& c, size_t size) {
+            c.resize(size);
+        }
+
+        template<typename T, size_t N>
+        void resize_container(std::array<T,N>& /*c*/, size_t size) {
+            assert( size == N && "Size mismatch for std::array." );
+        }
+
+     // Collect pointers to all elements of the containers at a level. (These are the containers of the
+     // next level.)
+        template<typename C, typename CPtr>
+        auto
+        next_level(std::vector<CPtr> const& level, size_t nElements)
+        {
+            using E = std::conditional_t< std::is_const_v<std::remove_pointer_t<CPtr>>
+                                        , typename C::value_type const
+                                        , typename C::value_type >;
+            std::vector<E*> next;
+            next.reserve(nElements);
+            for( auto pc : level )
+                for( auto& e : *pc )
+                    next.push_back(&e);
+            return next;
+        }
+
+     // Compute the size (bytes) of a level and all its subsequent levels.
+        template<typename C>
+        size_t
+        computeLevelBufferSize
+          ( std::vector<C const*> const& level
+          )
+        {
+            size_t nElements = 0;
+            for( auto pc : level ) nElements += pc->size();
+
+            size_t nBytes = level.size() * sizeof(size_t); // the table with cumulative sizes
+            using E = typename C::value_type;
+            if constexpr(fixed_size_memcpy_able<E>::value)
+                nBytes += nElements * sizeof(E); // the flat data block
+            else
+                nBytes += computeLevelBufferSize<E>( next_level<C>(level, nElements) );
+            return nBytes;
+        }
+
+     // Write a level and all its subsequent levels to dst, and advance dst.
+        template<typename C>
+        void
+        write_level
+          ( std::vector<C const*> const& level
+          , void*& dst
+          )
+        {// write the cumulative sizes of the containers at this level
+            std::vector<size_t> ends(level.size());
+            size_t nElements = 0;
+            for( size_t i = 0; i < level.size(); ++i ) {
+                nElements += level[i]->size();
+                ends[i] = nElements;
+            }
+            size_t nBytes = ends.size() * sizeof(size_t);
+            memcpy( dst, ends.data(), nBytes );
+            advance_void_ptr(dst, nBytes);
+
+            using E = typename C::value_type;
+            if constexpr(fixed_size_memcpy_able<E>::value)
+            {// write the flat data block
+                for( auto pc : level ) {
+                    nBytes = pc->size() * sizeof(E);
+                    if( nBytes ) memcpy( dst, pc->data(), nBytes );
+                    advance_void_ptr(dst, nBytes);
+                }
+            }
+            else
+                write_level<E>( next_level<C>(level, nElements), dst );
+        }
+
+     // Read a level and all its subsequent levels from src, and advance src.
+        template<typename C>
+        void
+        read_level
+          ( std::vector<C*> const& level
+          , void*& src
+          )
+        {// read the cumulative sizes of the containers at this level, and resize the containers
+            std::vector<size_t> ends(level.size());
+            size_t nBytes = ends.size() * sizeof(size_t);
+            memcpy( ends.data(), src, nBytes );
+            advance_void_ptr(src, nBytes);
+            size_t begin = 0;
+            for( size_t i = 0; i < level.size(); ++i ) {
+                resize_container(*level[i], ends[i] - begin);
+                begin = ends[i];
+            }
+            size_t nElements = begin;
+
+            using E = typename C::value_type;
+            if constexpr(fixed_size_memcpy_able<E>::value)
+            {// read the flat data block
+                for( auto pc : level ) {
+                    nBytes = pc->size() * sizeof(E);
+                    if( nBytes ) memcpy( pc->data(), src, nBytes );
+                    advance_void_ptr(src, nBytes);
+                }
+            }
+            else
+                read_level<E>( next_level<C>(level, nElements), src );
+        }
+
+     // Advance src past a level of nContainers containers and all its subsequent levels, without reading them.
+        template<typename C>
+        void
+        skip_level
+          ( size_t nContainers
+          , void*& src
+          )
+        {
+            size_t nElements = 0;
+            if( nContainers )
+                memcpy( &nElements, (char*)src + (nContainers - 1)*sizeof(size_t), sizeof(size_t) ); // the last cumulative size
+            advance_void_ptr(src, nContainers * sizeof(size_t));
+
+            using E = typename C::value_type;
+            if constexpr(fixed_size_memcpy_able<E>::value)
+                advance_void_ptr(src, nElements * sizeof(E));
+            else
+                skip_level<E>(nElements, src);
+        }
+
      //-------------------------------------------------------------------------------------------------
         template<typename T>
         struct memcpy_traits
@@ -54,6 +292,11 @@ namespace mpi
         {// C++17 required
             static bool const _debug_ = true;
 
+            static constexpr bool is_memcpy_able = packed_memcpy_able       <T>::value
+                                                || fixed_size_memcpy_able   <T>::value
+                                                || variable_size_memcpy_able<T>::value
+                                                || nested_memcpy_able       <T>::value;
+
          // Get a pointer to t's data.
             static 
             void*       // pointer to the beginning of the memory of the T object t 
@@ -76,7 +319,11 @@ namespace mpi
               ( T& t    // a T object t, either fixed_size_memcpy_able or variable_size_memcpy_able.
               ) 
             {
-                if constexpr(fixed_size_memcpy_able<T>::value) 
+                if constexpr(packed_memcpy_able<T>::value)
+                {// the size of the fields of a single T
+                    return packed_size<T>();
+                }
+                else if constexpr(fixed_size_memcpy_able<T>::value)
                 {// the size of a single T
                     return sizeof(T);
                 }
@@ -84,8 +331,12 @@ namespace mpi
                 {// the size of siz_t + the size of a single T::value_type times the number of items in the collection
                     return sizeof(size_t) + sizeof(typename T::value_type) * t.size();
                 }
+                else if constexpr(nested_memcpy_able<T>::value)
+                {// the size of all the levels
+                    return computeLevelBufferSize<T>( std::vector<T const*>(1, &t) );
+                }
                 else
-                    static_assert(fixed_size_memcpy_able<T>::value || variable_size_memcpy_able<T>::value, "type T is not memcpy-able");
+                    static_assert(is_memcpy_able, "type T is not memcpy-able");
             }
 
          // write a T to a buffer
@@ -95,8 +346,15 @@ namespace mpi
                             // the end of what was written, so the next object can be written to that position.
               ) 
             {
-
-                if constexpr(fixed_size_memcpy_able<T>::value)
+                if constexpr(packed_memcpy_able<T>::value)
+                {
+                    write_packed(t, dst);
+                    if constexpr(::mpi::_debug_ && _debug_) {
+                        prdbg( concatenate("packed_memcpy_able<T=", typeid(T).name(), ">::write(t, dst)")
+                             , Lines_t(1, concatenate("bytes written = ", packed_size<T>(), ", next dst = ", dst)) );
+                    }
+                }
+                else if constexpr(fixed_size_memcpy_able<T>::value)
                 {
                     if constexpr(::mpi::_debug_ && _debug_) {
                         Lines_t lines;
@@ -152,8 +410,16 @@ namespace mpi
                         prdbg( concatenate("variable_size_memcpy_able<T=", typeid(T).name(), ">::write(t, dst)"), lines);
                     }
                 }
+                else if constexpr(nested_memcpy_able<T>::value)
+                {
+                    if constexpr(::mpi::_debug_ && _debug_) {
+                        prdbg( concatenate("nested_memcpy_able<T=", typeid(T).name(), ">::write(t, dst)")
+                             , Lines_t(1, concatenate("size = ", t.size(), ", dst = ", dst)) );
+                    }
+                    write_level<T>( std::vector<T const*>(1, &t), dst );
+                }
                 else
-                    static_assert(fixed_size_memcpy_able<T>::value || variable_size_memcpy_able<T>::value, "type T is not memcpy-able");
+                    static_assert(is_memcpy_able, "type T is not memcpy-able");
             }
 
         // read a T from a buffer
@@ -163,7 +429,15 @@ namespace mpi
                             // the end of what was read, so the next object can be read from that position.
               ) 
             {
-                if constexpr(fixed_size_memcpy_able<T>::value)
+                if constexpr(packed_memcpy_able<T>::value)
+                {
+                    read_packed(t, src);
+                    if constexpr(::mpi::_debug_ && _debug_) {
+                        prdbg( concatenate("packed_memcpy_able<T=", typeid(T).name(), ">::read(t, src)")
+                             , Lines_t(1, concatenate("bytes read = ", packed_size<T>(), ", next src = ", src, "\n(done)")) );
+                    }
+                }
+                else if constexpr(fixed_size_memcpy_able<T>::value)
                 {
                     if constexpr(::mpi::_debug_ && _debug_) {
                         Lines_t lines;
@@ -221,8 +495,16 @@ namespace mpi
                         prdbg( concatenate("variable_size_memcpy_able<T=", typeid(T).name(), ">::read(t, src)"), lines);
                     }
                 }
+                else if constexpr(nested_memcpy_able<T>::value)
+                {
+                    read_level<T>( std::vector<T*>(1, &t), src );
+                    if constexpr(::mpi::_debug_ && _debug_) {
+                        prdbg( concatenate("nested_memcpy_able<T=", typeid(T).name(), ">::read(t, src)")
+                             , Lines_t(1, concatenate("size = ", t.size(), ", next src = ", src, "\n(done)")) );
+                    }
+                }
                 else
-                    static_assert(fixed_size_memcpy_able<T>::value || variable_size_memcpy_able<T>::value, "type T is not memcpy-able");
+                    static_assert(is_memcpy_able, "type T is not memcpy-able");
             }
         };
      //-------------------------------------------------------------------------------------------------
@@ -234,38 +516,321 @@ namespace mpi
     template <typename T>
     void write
       ( T& t       // the T object that will be read from a message buffer,
-                   // T must be either fixed_size_memcpy_able or variable_size_memcpy_able
+                   // T must be fixed_size_memcpy_able, variable_size_memcpy_able or nested_memcpy_able
       , void*& dst // pointer in the message buffer where t will be written to.
                    // On return the pointer is advanced to the position where the next
                    // object will be written, i.e. just behind t in the message buffer.
       )
     {
-            internal::memcpy_traits<T>::write(t,dst);
+        void* dst0 = dst;
+        internal::memcpy_traits<T>::write(t,dst);
+        trace::record(trace::memcpy, trace::verbose, trace::memcpy_write, (char*)dst - (char*)dst0, (uint64_t)dst0);
     }
 
     template <typename T>
     void read
       ( T& t       // the T object that will be read from a message buffer,
-                   // T must be either fixed_size_memcpy_able or variable_size_memcpy_able
+                   // T must be fixed_size_memcpy_able, variable_size_memcpy_able or nested_memcpy_able
       , void*& src // pointer in the message buffer where t will be read from.
                    // On return the pointer is advanced to the begin of the next object in 
                    // the message buffer, i.e. just behind t in the message buffer.
       )
     {
         if constexpr(_debug_) prdbg(concatenate("void read(T& t, void*& src), T=", typeid(T).name()));
+        void* src0 = src;
         internal::memcpy_traits<T>::read(t,src);
+        trace::record(trace::memcpy, trace::verbose, trace::memcpy_read, (char*)src - (char*)src0, (uint64_t)src0);
     }
 
  // Compute the size (bytes) that a T object will occupy when written to a buffer.
     template <typename T>
     size_t      // number of bytes
     computeItemBufferSize
-      (  T& t   // a T object, either fixed_size_memcpy_able or variable_size_memcpy_able
+      (  T& t   // a T object, fixed_size_memcpy_able, variable_size_memcpy_able or nested_memcpy_able
       ) 
     {
         return internal::memcpy_traits<T>::computeItemBufferSize(t);
     }
+
+ // The size (bytes) that any T object will occupy when written to a buffer, for T whose size in a
+ // buffer does not depend on the object (packed_memcpy_able or fixed_size_memcpy_able).
+    template <typename T>
+    constexpr size_t // number of bytes
+    fixedItemBufferSize()
+    {
+        if constexpr(internal::packed_memcpy_able<T>::value)
+            return internal::packed_size<T>();
+        else {
+            static_assert(internal::fixed_size_memcpy_able<T>::value, "type T is not fixed size memcpy-able");
+            return sizeof(T);
+        }
+    }
+ //-------------------------------------------------------------------------------------------------
+ // Bulk transfer of selected array elements.
+ // write_n writes data[indices[0]], data[indices[1]], ... to dst, read_n is its inverse. For fixed_size_memcpy_able
+ // and packed_memcpy_able types the result is the same as calling ::mpi::write / ::mpi::read for each element. The
+ // selected elements of variable_size_memcpy_able and nested_memcpy_able types (e.g. the bond partner lists of
+ // particles) are written as one level of a nested container: a table with the cumulative sizes of the selected
+ // elements, followed by a single contiguous block with all their values, e.g. {{1,2},{},{3}} is written as
+ //     [2,2,3] [1,2,3]
+ // (Unlike a nested container, the number of elements is not written, the reader knows it.)
+ // For fixed_size_memcpy_able types the elements are moved in a single pass over the indices, in blocks of
+ // blockSize elements:
+ //   - if a block starts a run of consecutive indices, the whole run is copied with a single memcpy,
+ //   - otherwise the block is gathered (scattered) with AVX2/AVX-512 instructions for 4 and 8 byte types, if
+ //     available, and with fixed size memcpy's otherwise,
+ //   - in large selections, the elements of the next block are prefetched.
+ // Note that the loads of the indices themselves are a significant part of the cost, in particular for small T.
+ //-------------------------------------------------------------------------------------------------
+    namespace internal
+    {
+        size_t const blockSize = 8;
+        size_t const prefetchThreshold = 1024; // prefetch in selections of at least this many elements
+
+     // Test if a block of consecutive indices starts at indices[i], and if so, return the length of the run.
+        inline size_t
+        run_length(Index_t const* indices, size_t i, size_t n)
+        {
+            if( i + blockSize > n || indices[i + blockSize - 1] != indices[i] + Index_t(blockSize - 1) )
+                return 0; // cheap test failed
+            size_t j = i + 1;
+            while( j < n && indices[j] == indices[j-1] + 1 ) ++j;
+            return j - i < blockSize ? 0 : j - i;
+        }
+
+     // Gather the elements of size S at base[indices[i]*S] for i in [0,blockSize[ to dst
+        template<size_t S>
+        inline void
+        gather_block(char const* base, Index_t const* indices, char* dst)
+        {
+#if defined(__AVX512F__)
+         // (masked gathers with an explicit zero source, the unmasked ones leave their source undefined)
+            if constexpr(S == 4) {
+                __m512i vi = _mm512_loadu_si512( (void const*)indices );
+                _mm256_storeu_si256( (__m256i*)dst, _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), 0xff, vi, base, 4) );
+                return;
+            }
+            if constexpr(S == 8) {
+                __m512i vi = _mm512_loadu_si512( (void const*)indices );
+                _mm512_storeu_si512( (void*)dst, _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xff, vi, base, 8) );
+                return;
+            }
+#elif defined(__AVX2__)
+            if constexpr(S == 4) {
+                for( size_t k = 0; k < blockSize; k += 4 ) {
+                    __m256i vi = _mm256_loadu_si256( (__m256i const*)(indices + k) );
+                    _mm_storeu_si128( (__m128i*)(dst + k*S), _mm256_i64gather_epi32((int const*)base, vi, 4) );
+                }
+                return;
+            }
+            if constexpr(S == 8) {
+                for( size_t k = 0; k < blockSize; k += 4 ) {
+                    __m256i vi = _mm256_loadu_si256( (__m256i const*)(indices + k) );
+                    _mm256_storeu_si256( (__m256i*)(dst + k*S), _mm256_i64gather_epi64((long long const*)base, vi, 8) );
+                }
+                return;
+            }
+#endif
+            for( size_t k = 0; k < blockSize; ++k )
+                std::memcpy( dst + k*S, base + indices[k]*S, S );
+        }
+
+     // Scatter blockSize elements of size S from src to base[indices[i]*S] for i in [0,blockSize[
+        template<size_t S>
+        inline void
+        scatter_block(char const* src, Index_t const* indices, char* base)
+        {
+#if defined(__AVX512F__)
+            if constexpr(S == 4) {
+                __m512i vi = _mm512_loadu_si512( (void const*)indices );
+                _mm512_i64scatter_epi32( base, vi, _mm256_loadu_si256( (__m256i const*)src ), 4 );
+                return;
+            }
+            if constexpr(S == 8) {
+                __m512i vi = _mm512_loadu_si512( (void const*)indices );
+                _mm512_i64scatter_epi64( base, vi, _mm512_loadu_si512( (void const*)src ), 8 );
+                return;
+            }
+#endif
+         // (AVX2 has no scatter instructions)
+            for( size_t k = 0; k < blockSize; ++k )
+                std::memcpy( base + indices[k]*S, src + k*S, S );
+        }
+
+        template<size_t S>
+        inline void
+        prefetch_block(char const* base, Index_t const* indices, int rw)
+        {
+            for( size_t k = 0; k < blockSize; ++k ) {
+                if( rw ) __builtin_prefetch( base + indices[k]*S, 1 );
+                else     __builtin_prefetch( base + indices[k]*S, 0 );
+            }
+        }
+
+     // Pointers to the selected elements, i.e. the selection as a level of a nested container.
+        template<typename T>
+        std::vector<T*>
+        selection_level(T* data, Index_t const* indices, size_t n)
+        {
+            std::vector<T*> level(n);
+            for( size_t i = 0; i < n; ++i )
+                level[i] = data + indices[i];
+            return level;
+        }
+
+        template<typename T>
+        struct level_memcpy_able
+          : std::bool_constant<variable_size_memcpy_able<T>::value || nested_memcpy_able<T>::value> {};
+    }// namespace internal
+
+    template <typename T>
+    void write_n
+      ( T const* data           // the array
+      , Index_t const* indices  // the indices of the selected elements
+      , size_t n                // the number of selected elements
+      , void*& dst              // pointer in a message buffer, advanced past the written elements on return
+      )
+    {
+        void* dst0 = dst;
+        if constexpr(internal::fixed_size_memcpy_able<T>::value && !internal::packed_memcpy_able<T>::value)
+        {
+            size_t const S = sizeof(T);
+            size_t const B = internal::blockSize;
+            char const* base = (char const*)data;
+            char*       d    = (char*)dst;
+            bool const prefetch = n >= internal::prefetchThreshold;
+            size_t i = 0;
+            while( i < n )
+            {
+                if( size_t len = internal::run_length(indices, i, n) ) {
+                    std::memcpy( d, base + indices[i]*S, len*S );
+                    d += len*S;
+                    i += len;
+                } else if( i + B <= n ) {
+                    if( prefetch && i + 2*B <= n )
+                        internal::prefetch_block<S>(base, indices + i + B, 0);
+                    internal::gather_block<S>(base, indices + i, d);
+                    d += B*S;
+                    i += B;
+                } else {
+                    for( ; i < n; ++i, d += S )
+                        std::memcpy( d, base + indices[i]*S, S );
+                }
+            }
+            dst = d;
+        } else if constexpr(internal::level_memcpy_able<T>::value) {
+            if( n ) internal::write_level<T>( internal::selection_level(data, indices, n), dst );
+        } else {
+            for( size_t i = 0; i < n; ++i )
+                internal::memcpy_traits<T>::write( const_cast<T&>(data[indices[i]]), dst );
+        }
+        trace::record(trace::memcpy, trace::verbose, trace::memcpy_write, (char*)dst - (char*)dst0, (uint64_t)dst0);
+    }
+
+    template <typename T>
+    void read_n
+      ( T* data                 // the array
+      , Index_t const* indices  // the indices of the selected elements
+      , size_t n                // the number of selected elements
+      , void*& src              // pointer in a message buffer, advanced past the read elements on return
+      )
+    {
+        void* src0 = src;
+        if constexpr(internal::fixed_size_memcpy_able<T>::value && !internal::packed_memcpy_able<T>::value)
+        {
+            size_t const S = sizeof(T);
+            size_t const B = internal::blockSize;
+            char*       base = (char*)data;
+            char const* s    = (char const*)src;
+            bool const prefetch = n >= internal::prefetchThreshold;
+            size_t i = 0;
+            while( i < n )
+            {
+                if( size_t len = internal::run_length(indices, i, n) ) {
+                    std::memcpy( base + indices[i]*S, s, len*S );
+                    s += len*S;
+                    i += len;
+                } else if( i + B <= n ) {
+                    if( prefetch && i + 2*B <= n )
+                        internal::prefetch_block<S>(base, indices + i + B, 1);
+                    internal::scatter_block<S>(s, indices + i, base);
+                    s += B*S;
+                    i += B;
+                } else {
+                    for( ; i < n; ++i, s += S )
+                        std::memcpy( base + indices[i]*S, s, S );
+                }
+            }
+            src = (void*)s;
+        } else if constexpr(internal::level_memcpy_able<T>::value) {
+            if( n ) internal::read_level<T>( internal::selection_level(data, indices, n), src );
+        } else {
+            for( size_t i = 0; i < n; ++i )
+                internal::memcpy_traits<T>::read( data[indices[i]], src );
+        }
+        trace::record(trace::memcpy, trace::verbose, trace::memcpy_read, (char*)src - (char*)src0, (uint64_t)src0);
+    }
+
+ // The number of bytes that write_n will write, computed in a single pass over the selection.
+    template <typename T>
+    size_t
+    computeBufferSize_n
+      ( T const* data           // the array
+      , Index_t const* indices  // the indices of the selected elements
+      , size_t n                // the number of selected elements
+      )
+    {
+        if constexpr(internal::packed_memcpy_able<T>::value || internal::fixed_size_memcpy_able<T>::value)
+            return n * fixedItemBufferSize<T>();
+        else if constexpr(internal::variable_size_memcpy_able<T>::value)
+        {// the table of cumulative sizes and the data block
+            size_t nValues = 0;
+            for( size_t i = 0; i < n; ++i )
+                nValues += data[indices[i]].size();
+            return n * sizeof(size_t) + nValues * sizeof(typename T::value_type);
+        }
+        else if constexpr(internal::nested_memcpy_able<T>::value)
+            return n ? internal::computeLevelBufferSize<T>( internal::selection_level(data, indices, n) ) : 0;
+        else
+            static_assert(internal::memcpy_traits<T>::is_memcpy_able, "type T is not memcpy-able");
+    }
+
+ // Convenience overloads for a std::vector (e.g. a ParticleArray) and a list of indices.
+    template <typename T, typename A>
+    inline void write_n(std::vector<T,A> const& v, Indices_t const& indices, void*& dst) {
+        write_n(v.data(), indices.data(), indices.size(), dst);
+    }
+    template <typename T, typename A>
+    inline void read_n(std::vector<T,A>& v, Indices_t const& indices, void*& src) {
+        read_n(v.data(), indices.data(), indices.size(), src);
+    }
+    template <typename T, typename A>
+    inline size_t computeBufferSize_n(std::vector<T,A> const& v, Indices_t const& indices) {
+        return computeBufferSize_n(v.data(), indices.data(), indices.size());
+    }
  //-------------------------------------------------------------------------------------------------
 }// namespace mpi
 
+//-------------------------------------------------------------------------------------------------
+// Declare the fields of a struct T that are to be written to and read from message buffers. T is then
+// written without its padding bytes. This must be used at global namespace scope, e.g.:
+//     struct Flagged { float value; int16_t flag; }; // sizeof(Flagged) == 8
+//     MPI_PACKED_FIELDS(Flagged, &Flagged::value, &Flagged::flag) // occupies 6 bytes in a message
+// The fields must be fixed_size_memcpy_able (checked at compile time). Fields that are not listed are not
+// transferred.
+//-------------------------------------------------------------------------------------------------
+#define MPI_PACKED_FIELDS(T, ...)                                           \
+    namespace mpi { namespace internal {                                    \
+        template<>                                                          \
+        struct packed_fields<T>                                             \
+        {                                                                   \
+            static constexpr bool value = true;                             \
+            static constexpr auto fields = std::make_tuple(__VA_ARGS__);    \
+            static_assert( packed_fields_fixed_size<                        \
+                               std::decay_t<decltype(fields)>>::value       \
+                         , "MPI_PACKED_FIELDS: the fields must be "         \
+                           "fixed_size_memcpy_able" );                      \
+        };                                                                  \
+    }}
+
 #endif // MEMCPY_ABLE_H
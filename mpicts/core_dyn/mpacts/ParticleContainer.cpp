@@ -1,20 +1,40 @@
 #include "ParticleContainer.h"
 
+#include "../SpaceFillingCurve.h"
+
+#include <algorithm>
+#if defined(__AVX512F__)
+#  include <immintrin.h>
+#endif
+
 namespace mpacts
 {//---------------------------------------------------------------------------------------------------------------------
     ParticleContainer::
-    ParticleContainer(int size, std::string const& name)
-      : r("r", *this)
-      , m("m", *this)
+    ParticleContainer(size_t size, std::string const& name)
+      : capacity_(size)
+      , ownedCapacity_(size)
+      , nAlive_(size)
+      , nGhosts_(0)
+      , compactionThreshold_(0.25)
       , name_(name)
+      , id_("id", *this)
+      , idMap_(2*size)
+      , nextId_(mpi::Id_t(mpi::rank) << 40)
+      , nGrows_(0)
+      , handleSlot_("handle", *this)
+      , r("r", *this)
+      , m("m", *this)
     {
-        alive_.resize(size);
-        r.resize(size);
-        m.resize(size);
+        alive_.assign((size + 63)/64, ~uint64_t(0));
+        if( size % 64 )
+            alive_.back() = (uint64_t(1) << (size % 64)) - 1; // the bits beyond the capacity are 0
+        for( size_t i=0; i<size; ++i) {
+            id_[i] = nextId_++;
+            idMap_.insert(id_[i], i);
+        }
 //            x.resize(size);
-        for( int i=0; i<size; ++i) {
-            int ir = 100*mpi::rank + i;
-            alive_[i] = true;
+        for( size_t i=0; i<size; ++i) {
+            real_t ir = 100*mpi::rank + i;
             r[i] = ir;
             m[i] = ir + size;
 //                for( int k=0; k<3; ++k )
@@ -26,31 +46,80 @@ namespace mpacts
     INFO_DEF(ParticleContainer)
     {
         std::stringstream ss;
-        ss<<indent<<"ParticleContainer::info("<<title<<") : name="<<name()<<", size="<<alive_.size()
+        ss<<indent<<"ParticleContainer::info("<<title<<") : name="<<name()<<", size="<<capacity_<<", alive="<<nAlive_
+          <<", ghosts="<<nGhosts_<<" from "<<ownedCapacity_
           <<indent<<"  a=alive[i], i=particle index, r=position[i], m=mass[i]"
           <<indent<<"  a"<<std::setw(4)<<"i"<<std::setw(4)<<"r"<<std::setw(4)<<"m";
-        for( int i=0; i<alive_.size(); ++i) {
-            ss<<indent<<"  "<<alive_[i]<<std::setw(4)<<i<<std::setw(4)<<r[i]<<std::setw(4)<<m[i];
+        for( mpi::Index_t i=0; i<mpi::Index_t(capacity_); ++i) {
+            ss<<indent<<"  "<<is_alive(i)<<std::setw(4)<<i<<std::setw(4)<<r[i]<<std::setw(4)<<m[i];
         }
         return ss.str();
     }
 
  //---------------------------------------------------------------------------------------------------------------------
- // Grow the arrays by a factor 1.5, and return the position of the first new element
- // (which is not alive, obviously).
-    int
-    ParticleContainer::
-    grow()
-    {
-        int old_size = alive_.size();
-        int new_size = (int)(old_size*1.5);
-        if (new_size == old_size) ++new_size;
-        alive_.resize(new_size);
-//            x.resize(new_size);
-        r.resize(new_size);
-        m.resize(new_size);
-        for (int i=old_size; i<new_size; ++i) {
-            alive_[i] = false;
+ // Set (value=true) or clear the bits [begin, end[ of a bitmap, a word at a time.
+    static inline void
+    setBits(std::vector<uint64_t>& words, size_t begin, size_t end, bool value)
+    {
+        for( size_t w = begin/64; begin < end; ++w )
+        {
+            size_t const b = begin - 64*w, e = std::min<size_t>(end - 64*w, 64);
+            uint64_t const bits = (e == 64 ? ~uint64_t(0) : (uint64_t(1) << e) - 1) & (~uint64_t(0) << b);
+            if( value ) words[w] |=  bits;
+            else        words[w] &= ~bits;
+            begin = 64*(w + 1);
+        }
+    }
+
+    void
+    ParticleContainer::
+    resize_(size_t n)
+    {
+        alive_.resize((n + 63)/64, 0); // the new particles are not alive
+        capacity_ = n;
+        for( auto pArray : arrays_ )
+            pArray->resizeArray(n);
+    }
+
+    void
+    ParticleContainer::
+    moveGhosts_(size_t begin)
+    {
+        size_t const oldBegin = ownedCapacity_;
+        ownedCapacity_ = begin;
+        if( begin == oldBegin || !nGhosts_ ) return;
+     // the ghost blocks may overlap: moving up, start with the last ghost, moving down, with the first one
+        mpi::Indices_t from(nGhosts_), to(nGhosts_);
+        for( size_t k = 0; k < nGhosts_; ++k ) {
+            size_t const g = begin > oldBegin ? nGhosts_ - 1 - k : k;
+            from[k] = oldBegin + g;
+            to  [k] = begin + g;
+        }
+        for( auto pArray : arrays_ )
+            pArray->moveElements(from.data(), to.data(), nGhosts_);
+        for( size_t k = 0; k < nGhosts_; ++k ) {
+            ghostIdMap_.update(id_[to[k]], from[k], to[k]);
+            relocateHandle_(to[k]);
+        }
+        setBits(alive_, oldBegin, oldBegin + nGhosts_, false);
+        setBits(alive_, begin, begin + nGhosts_, true);
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // Grow the owned region by a factor 1.5, or by nNew elements if that is more, and return the position of the
+ // first new element (which is not alive, obviously).
+    mpi::Index_t
+    ParticleContainer::
+    grow(size_t nNew)
+    {
+        mpi::Index_t old_size = ownedCapacity_;
+        mpi::Index_t new_size = grownCapacity(ownedCapacity_, nNew);
+        ++nGrows_;
+        resize_(new_size + (capacity_ - ownedCapacity_)); // the ghost capacity is kept
+        moveGhosts_(new_size);
+     // add the new elements to the free list, the lowest index on top
+        for (mpi::Index_t i=new_size-1; i>=old_size; --i) {
+            free_.push_back(i);
         }
         return old_size;
     }
@@ -60,21 +129,396 @@ namespace mpacts
     mpi::Index_t
     ParticleContainer::
     add()
-    {// look for a dead particle
-        mpi::Index_t iFree = -1;
-        for( Index_t i=0; i<alive_.size(); ++i) {
-            if (not alive_[i]) {
-                iFree = i;
-                break;
-            }
-        }
-        if( iFree == -1 )
-        {// none found, grow the array.
-            iFree = grow();
+    {
+        if( free_.empty() )
+        {// no dead particles, grow the array.
+            grow();
         }
-        alive_[iFree] = true;
+        mpi::Index_t iFree = free_.back();
+        free_.pop_back();
+        alive_[iFree >> 6] |= uint64_t(1) << (iFree & 63);
+        ++nAlive_;
+        handleSlot_[iFree] = 0;
+        id_[iFree] = nextId_++;
+        idMap_.insert(id_[iFree], iFree);
         if constexpr(::_debug_ && _debug_)
             ::prdbg(concatenate("ParticleContainer.add() -> ", iFree));
         return iFree;
     }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // Find or create indices for n new particles
+    mpi::Indices_t
+    ParticleContainer::
+    addN(size_t n)
+    {
+        mpi::Indices_t indices = addN_(n);
+        idMap_.reserve(idMap_.size() + n);
+        for( auto i : indices ) {
+            id_[i] = nextId_++;
+            idMap_.insert(id_[i], i);
+        }
+        return indices;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    addN(std::vector<mpi::Id_t> const& ids)
+    {
+        mpi::Indices_t indices = addN_(ids.size());
+        idMap_.reserve(idMap_.size() + ids.size());
+        for( size_t k = 0; k < ids.size(); ++k ) {
+            id_[indices[k]] = ids[k];
+            idMap_.insert(ids[k], indices[k]);
+        }
+        return indices;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    addN_(size_t n)
+    {
+        if( free_.size() < n )
+        {// grow the arrays once, the new elements are on top of the free list
+            grow( n - free_.size() );
+        }
+        mpi::Indices_t indices( free_.end() - n, free_.end() );
+        free_.resize( free_.size() - n );
+        std::sort( indices.begin(), indices.end() ); // runs of consecutive indices are transferred faster
+        for( auto i : indices ) {
+            alive_[i >> 6] |= uint64_t(1) << (i & 63);
+            handleSlot_[i] = 0;
+        }
+        nAlive_ += n;
+        if constexpr(::_debug_ && _debug_)
+            ::prdbg(concatenate("ParticleContainer.addN_(", n, ") -> ", indices.size(), " indices"));
+        return indices;
+    }
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    ParticleContainer::
+    reserveGhosts(size_t n)
+    {
+        size_t const ghostCapacity = capacity_ - ownedCapacity_;
+        if( nGhosts_ + n <= ghostCapacity ) return;
+        ++nGrows_;
+        resize_( ownedCapacity_ + std::max(ghostCapacity + ghostCapacity/2, nGhosts_ + n) );
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    addGhosts(std::vector<mpi::Id_t> const& ids)
+    {
+        size_t const n = ids.size();
+        reserveGhosts(n);
+        mpi::Index_t const begin = ghostEnd();
+        mpi::Indices_t indices(n);
+        ghostIdMap_.reserve(ghostIdMap_.size() + n);
+        for( size_t k = 0; k < n; ++k ) {
+            indices[k] = begin + k;
+            id_[begin + k] = ids[k];
+            handleSlot_[begin + k] = 0;
+            ghostIdMap_.insert(ids[k], begin + k);
+        }
+        setBits(alive_, begin, begin + n, true);
+        nGhosts_ += n;
+        nAlive_  += n;
+        if constexpr(::_debug_ && _debug_)
+            ::prdbg(concatenate("ParticleContainer.addGhosts(", n, ") -> [", begin, ", ", ghostEnd(), "["));
+        return indices;
+    }
+
+    void
+    ParticleContainer::
+    clearGhosts()
+    {
+        if( nHandles() )
+            for( mpi::Index_t i = ghostBegin(); i < ghostEnd(); ++i )
+                if( handleSlot_[i] ) releaseHandle_(i);
+        setBits(alive_, ghostBegin(), ghostEnd(), false);
+        nAlive_ -= nGhosts_;
+        nGhosts_ = 0;
+        ghostIdMap_.clear();
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // The bits of word w of the alive mask (or of its complement) that are in [begin, end[
+    static inline uint64_t
+    maskedWord(std::vector<uint64_t> const& words, bool alive, size_t w, mpi::Index_t begin, mpi::Index_t end)
+    {
+        uint64_t bits = alive ? words[w] : ~words[w];
+        mpi::Index_t w0 = 64*w;
+        if( begin > w0 ) bits &= ~uint64_t(0) << (begin - w0);
+        if( end < w0 + 64 ) bits &= (uint64_t(1) << (end - w0)) - 1;
+        return bits;
+    }
+
+    size_t
+    ParticleContainer::
+    countAlive(mpi::Index_t begin, mpi::Index_t end) const
+    {
+        if( begin >= end ) return 0;
+        size_t n = 0;
+        for( size_t w = begin/64; w <= size_t(end - 1)/64; ++w )
+            n += __builtin_popcountll( maskedWord(alive_, true, w, begin, end) );
+        return n;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    select(bool alive, mpi::Index_t begin, mpi::Index_t end) const
+    {
+        mpi::Indices_t indices;
+        if( begin >= end ) return indices;
+        size_t const wBegin = begin/64, wEnd = size_t(end - 1)/64 + 1;
+     // count first, so that the output is allocated once
+        size_t n = 0;
+        for( size_t w = wBegin; w < wEnd; ++w )
+            n += __builtin_popcountll( maskedWord(alive_, alive, w, begin, end) );
+        indices.resize(n);
+        mpi::Index_t* out = indices.data();
+        for( size_t w = wBegin; w < wEnd; ++w )
+        {
+            uint64_t bits = maskedWord(alive_, alive, w, begin, end);
+            if( !bits ) continue;
+#if defined(__AVX512F__)
+         // compress the indices of the set bits, 8 at a time
+            __m512i idx = _mm512_add_epi64( _mm512_set1_epi64(64*w), _mm512_setr_epi64(0,1,2,3,4,5,6,7) );
+            __m512i const eight = _mm512_set1_epi64(8);
+            for( int k = 0; k < 8; ++k ) {
+                __mmask8 mask = (__mmask8)(bits >> 8*k);
+                _mm512_mask_compressstoreu_epi64( out, mask, idx );
+                out += __builtin_popcount(mask);
+                idx = _mm512_add_epi64(idx, eight);
+            }
+#else
+            for( ; bits; bits &= bits - 1 )
+                *out++ = mpi::Index_t(64*w + __builtin_ctzll(bits));
+#endif
+        }
+        return indices;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    void
+    ParticleContainer::
+    unregisterArray(ParticleArrayBase* pArray)
+    {
+        auto iter = std::find(arrays_.begin(), arrays_.end(), pArray);
+        if( iter != arrays_.end() )
+            arrays_.erase(iter);
+    }
+
+    ParticleArrayBase*
+    ParticleContainer::
+    array(std::string const& name) const
+    {
+        for( auto pArray : arrays_ )
+            if( pArray->name() == name ) return pArray;
+        return nullptr;
+    }
+
+    std::vector<std::string>
+    ParticleContainer::
+    arrayNames() const
+    {
+        std::vector<std::string> names;
+        for( auto pArray : arrays_ )
+            if( pArray != &id_ && pArray != &handleSlot_ ) names.push_back( pArray->name() );
+        return names;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    std::vector<mpi::Id_t>
+    ParticleContainer::
+    ids(mpi::Indices_t const& indices) const
+    {
+        std::vector<mpi::Id_t> result(indices.size());
+        for( size_t k = 0; k < indices.size(); ++k )
+            result[k] = id_[indices[k]];
+        return result;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    indices(std::vector<mpi::Id_t> const& ids) const
+    {
+        mpi::Indices_t result = idMap_.find(ids);
+        if( !ghostIdMap_.empty() )
+            for( size_t k = 0; k < ids.size(); ++k )
+                if( result[k] < 0 ) result[k] = ghostIdMap_.find(ids[k]);
+        return result;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+    ParticleHandle
+    ParticleContainer::
+    handle(mpi::Index_t i)
+    {
+        assert( is_alive(i) && "Handle of a dead particle." );
+        uint32_t s = handleSlot_[i];
+        if( !s )
+        {// take a free slot, or append one
+            if( freeSlots_.empty() ) {
+                assert( slotIndex_.size() < ~uint32_t(0) - 1 && "Too many particle handles." );
+                s = slotIndex_.size();
+                slotIndex_.push_back(i);
+                slotGeneration_.push_back(0);
+            } else {
+                s = freeSlots_.back();
+                freeSlots_.pop_back();
+                slotIndex_[s] = i;
+            }
+            handleSlot_[i] = ++s;
+        }
+        return { s - 1, slotGeneration_[s - 1] };
+    }
+
+    std::vector<ParticleHandle>
+    ParticleContainer::
+    handles(mpi::Indices_t const& indices)
+    {
+        std::vector<ParticleHandle> result(indices.size());
+        for( size_t k = 0; k < indices.size(); ++k )
+            result[k] = handle(indices[k]);
+        return result;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    indices(std::vector<ParticleHandle> const& handles) const
+    {
+        mpi::Indices_t result(handles.size());
+        for( size_t k = 0; k < handles.size(); ++k )
+            result[k] = index(handles[k]);
+        return result;
+    }
+
+    void
+    ParticleContainer::
+    releaseHandle_(mpi::Index_t i)
+    {
+        uint32_t const s = handleSlot_[i] - 1;
+        ++slotGeneration_[s]; // the outstanding handles become invalid
+        slotIndex_[s] = -1;
+        freeSlots_.push_back(s);
+        handleSlot_[i] = 0;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
+ // Move the live owned particles into a dense prefix
+    mpi::Indices_t
+    ParticleContainer::
+    compact(bool shrink)
+    {
+        mpi::Index_t const nOwned = this->nOwned();
+        mpi::Indices_t from = select(true, nOwned, ownedCapacity_); // the live particles beyond the prefix
+        mpi::Indices_t to   = select(false, 0, nOwned);             // the holes in the prefix
+        assert( from.size() == to.size() && "Inconsistent live count." );
+
+        mpi::Indices_t remap(capacity_, -1);
+        forEachAlive( [&remap](mpi::Index_t i) { remap[i] = i; } );
+        for( size_t k = 0; k < from.size(); ++k )
+            remap[from[k]] = to[k];
+
+        if( !from.empty() )
+            for( auto pArray : arrays_ ) {
+                assert( pArray->arraySize() >= capacity_ && "ParticleArray smaller than its ParticleContainer." );
+                pArray->moveElements(from.data(), to.data(), from.size());
+            }
+        for( size_t k = 0; k < from.size(); ++k ) {
+            idMap_.update(id_[to[k]], from[k], to[k]);
+            relocateHandle_(to[k]);
+        }
+
+     // the alive mask of the owned region: the first nOwned bits are set
+        setBits(alive_, 0, nOwned, true);
+        setBits(alive_, nOwned, ownedCapacity_, false);
+        if( shrink )
+        {// move the ghosts down, behind the prefix
+            size_t const oldBegin = ownedCapacity_;
+            moveGhosts_(nOwned);
+            for( size_t g = 0; g < nGhosts_; ++g )
+                remap[oldBegin + g] = nOwned + g;
+            resize_(nOwned + nGhosts_);
+        }
+     // the free list: the slots beyond the prefix, the lowest index on top
+        free_.clear();
+        for( mpi::Index_t i = ownedCapacity_ - 1; i >= nOwned; --i )
+            free_.push_back(i);
+        if( shrink ) {
+            alive_.shrink_to_fit();
+            free_.shrink_to_fit();
+        }
+        if constexpr(::_debug_ && _debug_)
+            ::prdbg(concatenate("ParticleContainer.compact() moved ", from.size(), " particles"));
+        return remap;
+    }
+
+    mpi::Indices_t
+    ParticleContainer::
+    reorder(std::vector<uint64_t> const& keys)
+    {
+        assert( keys.size() >= capacity_ && "A key is needed for every particle." );
+        mpi::Indices_t remap = compact();
+        size_t const n = nOwned();
+     // sort the particles in the dense prefix by key: order[p] is the particle that moves to p
+        std::vector<uint64_t> sortedKeys(n);
+        mpi::Indices_t order(n);
+        for( size_t i = 0; i < remap.size(); ++i )
+            if( remap[i] >= 0 && size_t(remap[i]) < n ) sortedKeys[remap[i]] = keys[i];
+        for( size_t p = 0; p < n; ++p ) order[p] = p;
+        mpi::sfc::radixSort(sortedKeys, order);
+     // the cycles of the permutation, shared by all arrays
+        std::vector<mpi::Index_t> cycles;
+        std::vector<bool> done(n, false);
+        for( size_t p0 = 0; p0 < n; ++p0 )
+        {
+            if( done[p0] || order[p0] == mpi::Index_t(p0) ) continue;
+            size_t c = cycles.size();
+            cycles.push_back(0);
+            for( mpi::Index_t p = p0; !done[p]; p = order[p] ) {
+                done[p] = true;
+                cycles.push_back(p);
+            }
+            cycles[c] = cycles.size() - c - 1;
+        }
+        if( !cycles.empty() )
+            for( auto pArray : arrays_ )
+                pArray->permuteCycles(cycles);
+     // the ID map and the old to new index map
+        mpi::Indices_t position(n);
+        for( size_t p = 0; p < n; ++p ) {
+            position[order[p]] = p;
+            if( order[p] != mpi::Index_t(p) ) {
+                idMap_.update(id_[p], order[p], p);
+                relocateHandle_(p);
+            }
+        }
+        for( auto& i : remap )
+            if( i >= 0 && size_t(i) < n ) i = position[i]; // the ghosts do not move
+        if constexpr(::_debug_ && _debug_)
+            ::prdbg(concatenate("ParticleContainer.reorder() ", n, " particles"));
+        return remap;
+    }
+
+    void
+    ParticleContainer::
+    remapIndices(mpi::Indices_t& indices, mpi::Indices_t const& remap)
+    {
+        for( auto& i : indices )
+            i = remap[i];
+    }
+
+    bool
+    ParticleContainer::
+    compactIfFragmented(mpi::Indices_t& remap, bool shrink)
+    {
+        if( nMisplaced() <= compactionThreshold_*nOwned() )
+            return false;
+        remap = compact(shrink);
+        return true;
+    }
+
+ //---------------------------------------------------------------------------------------------------------------------
 }// namespace mpacts
@@ -3,10 +3,18 @@
 #include <Eigen/Geometry> //?
 
 #include "../mpicts.h"
+#include "../IdMap.h"
+#include "../MemoryPolicy.h"
+#include "../PagedArray.h"
 using namespace mpi;
 
 // this should be replaced with the real Mpacts ParticleContainer and ParticleArray
 
+namespace mpi
+{
+    class PcMessageHandler;
+}
+
 namespace mpacts
 {//---------------------------------------------------------------------------------------------------------------------
     typedef Eigen::Matrix<float, 3, 1, Eigen::DontAlign> vec_t;
@@ -14,69 +22,418 @@ namespace mpacts
 
     class ParticleContainer;
  //---------------------------------------------------------------------------------------------------------------------
-    template<typename T>
-    class ParticleArray : public std::vector<T>
+    class ParticleArrayBase
+ // Type erased interface of the ParticleArrays, for the ParticleContainer to resize and reorder all its arrays.
+ //---------------------------------------------------------------------------------------------------------------------
+    {
+    public:
+        virtual ~ParticleArrayBase() {}
+        virtual std::string const& name() const = 0;
+        virtual size_t arraySize() const = 0;
+        virtual void resizeArray(size_t n) = 0;
+     // Move element from[k] to to[k], for k in [0, n[. The elements must be distinct.
+        virtual void moveElements(mpi::Index_t const* from, mpi::Index_t const* to, size_t n) = 0;
+     // Permute the elements along cycles. cycles is a sequence of cycles [length, i0, i1, ... i(length-1)]:
+     // element i0 is replaced by element i1, i1 by i2, ..., and i(length-1) by the original element i0.
+        virtual void permuteCycles(std::vector<mpi::Index_t> const& cycles) = 0;
+     // Add the array to the messages of hndlr (with its actual type).
+        virtual void addToMessages(mpi::PcMessageHandler& hndlr) = 0;
+    };
+
+ //---------------------------------------------------------------------------------------------------------------------
+    template<typename T, typename Storage = std::vector<T>>
+    class ParticleArray : public Storage, public ParticleArrayBase
+ // A ParticleArray registers itself with its ParticleContainer, which sizes it to the container's capacity,
+ // resizes it when the container grows and moves its elements when the container is compacted.
+ // The elements are stored in a std::vector (contiguous, reallocated when the container grows), or in an
+ // mpi::PagedArray (see PagedParticleArray: the elements never move when the container grows, but particle_major
+ // messages, which need contiguous arrays, fall back to array_major).
  //---------------------------------------------------------------------------------------------------------------------
     {
     private: // data members
         std::string name_;
         ParticleContainer& pc_;
     public:
-        ParticleArray(std::string const& name, ParticleContainer& pc)
-          : name_(name), pc_(pc)
-        {}
+        ParticleArray(std::string const& name, ParticleContainer& pc);
+     // Construct the storage from storageArgs, e.g. an allocator.
+        template<typename... Args>
+        ParticleArray(std::string const& name, ParticleContainer& pc, Args&&... storageArgs);
+        ParticleArray(ParticleArray const& other);
+        ~ParticleArray();
+
         std::string const& name() const { return name_; }
-        std::string const& particleContainer() const { return pc_; }
+        ParticleContainer const& particleContainer() const { return pc_; }
+
+     // ParticleArrayBase interface
+        virtual size_t arraySize() const { return this->size(); }
+        virtual void
+        resizeArray(size_t n)
+        {
+            bool shrink = n < this->size();
+            this->resize(n);
+            if( shrink ) this->shrink_to_fit();
+        }
+        virtual void
+        moveElements(mpi::Index_t const* from, mpi::Index_t const* to, size_t n)
+        {
+            Storage& data = *this;
+            for( size_t k = 0; k < n; ++k )
+                data[to[k]] = std::move(data[from[k]]);
+        }
+        virtual void
+        permuteCycles(std::vector<mpi::Index_t> const& cycles)
+        {
+            Storage& data = *this;
+            for( size_t c = 0; c < cycles.size(); )
+            {
+                size_t const length = cycles[c];
+                mpi::Index_t const* cycle = &cycles[c + 1];
+                T first = std::move(data[cycle[0]]);
+                for( size_t k = 0; k + 1 < length; ++k )
+                    data[cycle[k]] = std::move(data[cycle[k + 1]]);
+                data[cycle[length - 1]] = std::move(first);
+                c += 1 + length;
+            }
+        }
+     // Defined in ../ParticleContainer.h, where PcMessageHandler is complete.
+        virtual void addToMessages(mpi::PcMessageHandler& hndlr);
 
         INFO_DECL
         {
             std::stringstream ss;
-            ss<<indent<<"ParticleArray<"<<typeid(T).name()<<">::info("<<title<<") : name="<<name()<<", pc="<<particleContainer().name();
+            ss<<indent<<"ParticleArray<"<<typeid(T).name()<<','<<typeid(Storage).name()<<">::info("<<title<<") : name="<<name()<<", pc="<<particleContainer().name();
             return ss.str();
         }
     };
 
+ // A ParticleArray with paged storage.
+    template<typename T>
+    using PagedParticleArray = ParticleArray<T, mpi::PagedArray<T>>;
+
+ // A ParticleArray allocated according to an mpi::MemoryPolicy (huge pages, parallel first touch, NUMA binding):
+ //     PolicyParticleArray<float> a("a", pc, mpi::MemoryPolicy::node(1));
+    template<typename T>
+    using PolicyParticleArray = ParticleArray<T, std::vector<T, mpi::PolicyAllocator<T>>>;
+
+ //---------------------------------------------------------------------------------------------------------------------
+    struct ParticleHandle
+ // A stable reference to a particle on this rank, which survives compaction, reordering and growth, as opposed
+ // to its index. The slot is an entry of the handle table of the ParticleContainer, the generation is bumped
+ // when the particle is removed, so that the handles of dead particles are recognized even if the slot is
+ // reused. Handles are local, particles that migrate are referred to by their ID.
+ //---------------------------------------------------------------------------------------------------------------------
+    {
+        uint32_t slot = ~uint32_t(0);
+        uint32_t generation = 0;
+        bool operator==(ParticleHandle const& other) const { return slot == other.slot && generation == other.generation; }
+        bool operator!=(ParticleHandle const& other) const { return !(*this == other); }
+    };
+
  //---------------------------------------------------------------------------------------------------------------------
     class ParticleContainer
+ // The alive mask is a bitmap of 64 bit words, bit i%64 of word i/64 is set if particle i is alive. The bits beyond
+ // the capacity are always 0. Loops over the live particles skip dead particles a word at a time:
+ //     for( mpi::Index_t i : pc.alive() ) ...
+ // Every particle has a global ID, which it keeps when it migrates. New particles get IDs from a per rank
+ // range (rank << 40). The ID to index map of the live particles is kept in sync by add(), remove() and
+ // compact().
+ // The owned particles are in [0, ownedCapacity()[, the ghost particles (copies of particles owned by another
+ // rank, received in copy mode) in a contiguous tail [ghostBegin(), ghostEnd()[ behind them. Ghosts are
+ // appended sequentially, have their own ID map (a copy sent to the same rank does not replace the original),
+ // and are removed all at once by clearGhosts(). The free list, add(), remove() and compact() only concern the
+ // owned region, so after compact() the owned particles [0, nOwned()[ can be looped over without alive check.
+ // Code that keeps references to particles across compaction or reordering should hold ParticleHandles, which
+ // are translated to indices in O(1) by index(handle).
  //---------------------------------------------------------------------------------------------------------------------
     {
         static bool const _debug_ = false;
-        std::vector<bool> alive_;
+        std::vector<uint64_t> alive_;    // the alive mask
+        size_t capacity_;                // the number of particles, dead or alive, owned or ghost
+        size_t ownedCapacity_;           // the size of the owned region, the ghost region starts here
+        size_t nAlive_;                  // the number of live particles, including the ghosts
+        size_t nGhosts_;                 // the number of ghost particles
+        std::vector<mpi::Index_t> free_; // the dead particles, as a stack: the lowest index is on top after grow().
+        std::vector<ParticleArrayBase*> arrays_; // the registered ParticleArrays (not owned), including r and m
+        double compactionThreshold_;     // see compactIfFragmented()
         std::string name_;
+        PagedParticleArray<mpi::Id_t> id_; // the global IDs (registered, so that it grows and compacts with the others)
+        mpi::IdMap idMap_;               // ID -> index of the live owned particles
+        mpi::IdMap ghostIdMap_;          // ID -> index of the ghost particles
+        mpi::Id_t nextId_;               // the ID of the next particle created on this rank
+        size_t nGrows_;                  // the number of calls to grow()
+        PagedParticleArray<uint32_t> handleSlot_; // the handle slot of each particle + 1, 0 if it has no handle (registered)
+        std::vector<mpi::Index_t> slotIndex_;  // the handle table: the index of the particle of each slot
+        std::vector<uint32_t> slotGeneration_; // the generation of each slot
+        std::vector<uint32_t> freeSlots_;      // the unused slots
     public:
         ParticleArray<real_t> r;
         ParticleArray<real_t> m;
 //        std::vector<vec_t>   x;
 
-        ParticleContainer( int size, std::string const& name);
+        ParticleContainer( size_t size, std::string const& name);
 
         INFO_DECL;
 
         inline
-        size_t // the size of a particle container.
+        size_t // the size of a particle container, i.e. its capacity (the size of the ParticleArrays).
         size() const {
-            return alive_.size();
+            return capacity_;
+        }
+        inline size_t capacity() const { return capacity_; }
+
+     // The number of live particles, including the ghosts. O(1).
+        inline size_t nAlive() const { return nAlive_; }
+     // The number of live owned particles. O(1).
+        inline size_t nOwned() const { return nAlive_ - nGhosts_; }
+
+     // The ghost region.
+        inline size_t nGhosts()       const { return nGhosts_; }
+        inline size_t ownedCapacity() const { return ownedCapacity_; }
+        inline mpi::Index_t ghostBegin() const { return mpi::Index_t(ownedCapacity_); }
+        inline mpi::Index_t ghostEnd()   const { return mpi::Index_t(ownedCapacity_ + nGhosts_); }
+        inline bool is_ghost(mpi::Index_t i) const { return size_t(i) >= ownedCapacity_; }
+
+     // Grow the owned region by a factor 1.5, or by nNew elements if that is more, and return the position of
+     // the first new element (which is not alive, obviously). The new elements are added to the free list.
+     // The ghosts are moved up.
+        mpi::Index_t grow(size_t nNew = 1);
+     // The capacity after growing a region of this capacity for nNew more elements.
+        static size_t grownCapacity(size_t capacity, size_t nNew) {
+            return std::max(capacity + capacity/2, capacity + nNew);
         }
 
-     // Grow the arrays by a factor 1.5, and return the position of the first new element
-     // (which is not alive, obviously).
-        int grow();
+     // Make room for n new particles, growing the arrays at most once, so that the next n calls to add() or
+     // addN() do not reallocate.
+        void reserve(size_t n) {
+            if( free_.size() < n ) grow( n - free_.size() );
+        }
+
+     // Make room for n more ghosts, growing the ghost region at most once.
+        void reserveGhosts(size_t n);
+
+     // Append ghosts with these IDs to the ghost region. Returns their indices, which are consecutive.
+        mpi::Indices_t addGhosts(std::vector<mpi::Id_t> const& ids);
 
-     // Find an index for a new particle
+     // Remove all ghosts. Only the alive bits of the ghost region and the ghost ID map are cleared, the owned
+     // particles are not visited.
+        void clearGhosts();
+
+     // The number of times the arrays were grown.
+        size_t nGrows() const { return nGrows_; }
+
+     // Find an index for a new particle. O(1).
         mpi::Index_t add();
 
-     // remove an element
-        inline void remove(int i) {
-            alive_[i] = false;
+     // Find indices for n new particles, in increasing order. Elements created by growing the arrays
+     // are contiguous. O(n log n) at most.
+        mpi::Indices_t addN(size_t n);
+
+     // Find indices for particles with known IDs (e.g. received from another rank), in increasing order.
+        mpi::Indices_t addN(std::vector<mpi::Id_t> const& ids);
+
+     // remove an owned element (ghosts are removed by clearGhosts())
+        inline void remove(mpi::Index_t i) {
+            assert( size_t(i) < ownedCapacity_ && "Ghost particles are removed by clearGhosts()." );
+            uint64_t bit = uint64_t(1) << (i & 63);
+            if( alive_[i >> 6] & bit ) {
+                alive_[i >> 6] &= ~bit;
+                --nAlive_;
+                free_.push_back(i);
+                idMap_.erase(id_[i], i);
+                if( handleSlot_[i] ) releaseHandle_(i);
+            }
         }
 
+     // The number of dead particles.
+        inline size_t nFree() const { return free_.size(); }
+
      // test if alive
-        inline bool is_alive(int i) const {
-            return alive_[i];
+        inline bool is_alive(mpi::Index_t i) const {
+            return (alive_[i >> 6] >> (i & 63)) & 1;
+        }
+
+     //-----------------------------------------------------------------------------------------------------------------
+        class AliveIterator
+     // Iterates over the indices of the live particles, in increasing order.
+     //-----------------------------------------------------------------------------------------------------------------
+        {
+            uint64_t const* words_;
+            size_t nWords_;
+            size_t w_;      // the current word
+            uint64_t bits_; // the bits of the current word that are not visited yet
+        public:
+            AliveIterator(uint64_t const* words, size_t nWords, size_t w)
+              : words_(words), nWords_(nWords), w_(w), bits_(w < nWords ? words[w] : 0)
+            {
+                skip_();
+            }
+            mpi::Index_t operator*() const { return mpi::Index_t(64*w_ + __builtin_ctzll(bits_)); }
+            AliveIterator& operator++() {
+                bits_ &= bits_ - 1; // clear the lowest bit
+                skip_();
+                return *this;
+            }
+            bool operator!=(AliveIterator const& other) const { return w_ != other.w_ || bits_ != other.bits_; }
+        private:
+            void skip_() {// skip words without live particles
+                while( !bits_ && ++w_ < nWords_ )
+                    bits_ = words_[w_];
+                if( w_ >= nWords_ ) {
+                    w_ = nWords_;
+                    bits_ = 0;
+                }
+            }
+        };
+
+        struct AliveRange {
+            AliveIterator b, e;
+            AliveIterator begin() const { return b; }
+            AliveIterator end()   const { return e; }
+        };
+
+     // The live particles, for range based for loops.
+        AliveRange alive() const {
+            return { AliveIterator(alive_.data(), alive_.size(), 0)
+                   , AliveIterator(alive_.data(), alive_.size(), alive_.size()) };
+        }
+
+     // Call f(i) for every live particle i.
+        template<typename F>
+        void
+        forEachAlive(F f) const
+        {
+            for( size_t w = 0; w < alive_.size(); ++w )
+                for( uint64_t bits = alive_[w]; bits; bits &= bits - 1 )
+                    f( mpi::Index_t(64*w + __builtin_ctzll(bits)) );
         }
 
+     // The number of live particles in [begin, end[.
+        size_t countAlive(mpi::Index_t begin, mpi::Index_t end) const;
+
+     // The indices of the live (alive=true) or dead (alive=false) particles in [begin, end[, in increasing
+     // order. Vectorized with AVX-512, if available.
+        mpi::Indices_t select(bool alive, mpi::Index_t begin, mpi::Index_t end) const;
+        mpi::Indices_t select(bool alive = true) const { return select(alive, 0, capacity_); }
+
+     // The global ID of particle i.
+        mpi::Id_t id(mpi::Index_t i) const { return id_[i]; }
+     // The global IDs of the selected particles.
+        std::vector<mpi::Id_t> ids(mpi::Indices_t const& indices) const;
+
+     // The index of the live particle with this ID, or -1. Owned particles are found before ghosts.
+        mpi::Index_t index(mpi::Id_t id) const {
+            mpi::Index_t i = idMap_.find(id);
+            return i >= 0 ? i : ghostIdMap_.find(id);
+        }
+     // The indices of the live particles with these IDs (-1 for unknown IDs), with batched lookups.
+        mpi::Indices_t indices(std::vector<mpi::Id_t> const& ids) const;
+
+        mpi::IdMap const& idMap()      const { return idMap_; }
+        mpi::IdMap const& ghostIdMap() const { return ghostIdMap_; }
+
+     // The handle of live particle i, which is created on first use. O(1).
+        ParticleHandle handle(mpi::Index_t i);
+        std::vector<ParticleHandle> handles(mpi::Indices_t const& indices);
+     // The index of the particle of a handle, or -1 if the particle was removed (or the handle is invalid). O(1).
+        inline mpi::Index_t
+        index(ParticleHandle h) const {
+            return h.slot < slotGeneration_.size() && slotGeneration_[h.slot] == h.generation ? slotIndex_[h.slot] : -1;
+        }
+        mpi::Indices_t indices(std::vector<ParticleHandle> const& handles) const;
+     // The number of particles with a handle.
+        size_t nHandles() const { return slotIndex_.size() - freeSlots_.size(); }
+
+     // The alive mask (for vectorized loops).
+        std::vector<uint64_t> const& aliveMask() const { return alive_; }
+
+     // Register/unregister a ParticleArray (done by the ParticleArray ctor and dtor).
+        void registerArray(ParticleArrayBase* pArray) { arrays_.push_back(pArray); }
+        void unregisterArray(ParticleArrayBase* pArray);
+        std::vector<ParticleArrayBase*> const& arrays() const { return arrays_; }
+
+     // The registered array with this name (the first one, if there are copies), or nullptr.
+        ParticleArrayBase* array(std::string const& name) const;
+     // The names of the registered arrays, in order of registration, except the IDs (which are part of every
+     // message) and the handle slots (which are local).
+        std::vector<std::string> arrayNames() const;
+
+     // The number of live owned particles outside the dense prefix [0, nOwned()[, i.e. the number of particles
+     // compact() would move.
+        size_t nMisplaced() const { return nOwned() - countAlive(0, nOwned()); }
+
+     // Move the live owned particles into the dense prefix [0, nOwned()[ of all registered arrays, in a single
+     // pass per array. Live particles beyond the prefix fill the holes in the prefix, in increasing order;
+     // live particles inside the prefix do not move. Returns the old to new index map, of size capacity()
+     // before compaction, with -1 for dead particles. If shrink is true, the owned capacity is reduced to
+     // nOwned() and the ghost capacity to nGhosts() (the ghosts move down, but keep their order).
+     // Indices held elsewhere (e.g. by pending messages) must be updated with the returned map.
+        mpi::Indices_t compact(bool shrink = false);
+
+     // Compact if the fraction of misplaced particles, nMisplaced()/nOwned(), exceeds the compaction
+     // threshold. Returns true and the index map in remap if the container was compacted.
+        bool compactIfFragmented(mpi::Indices_t& remap, bool shrink = false);
+
+     // Compact, and sort the live owned particles by key (keys[i] is the key of particle i, e.g. a space filling
+     // curve key of its position, see mpi::sfc), with a radix sort. All registered arrays are permuted in
+     // place, and the ID map is updated. Returns the old to new index map, as compact().
+        mpi::Indices_t reorder(std::vector<uint64_t> const& keys);
+
+     // Replace the indices by their new values after compact() or reorder(). Indices of particles that
+     // were dead become -1.
+        static void remapIndices(mpi::Indices_t& indices, mpi::Indices_t const& remap);
+        void   setCompactionThreshold(double threshold) { compactionThreshold_ = threshold; }
+        double compactionThreshold() const { return compactionThreshold_; }
+
         std::string const& name() const { return name_; }
+    private:
+     // Take n slots from the free list, growing once if necessary, without assigning IDs.
+        mpi::Indices_t addN_(size_t n);
+     // Resize the alive mask and all registered arrays to n elements.
+        void resize_(size_t n);
+     // Move the ghosts to [begin, begin + nGhosts()[, and make begin the end of the owned region.
+        void moveGhosts_(size_t begin);
+     // Invalidate the handle of particle i, and free its slot.
+        void releaseHandle_(mpi::Index_t i);
+     // Point the handle of particle i (if any) to i, after it moved.
+        inline void relocateHandle_(mpi::Index_t i) {
+            if( uint32_t s = handleSlot_[i] ) slotIndex_[s - 1] = i;
+        }
     };
+
+ //---------------------------------------------------------------------------------------------------------------------
+    template<typename T, typename Storage>
+    ParticleArray<T, Storage>::
+    ParticleArray(std::string const& name, ParticleContainer& pc)
+      : name_(name), pc_(pc)
+    {
+        this->resize(pc_.capacity());
+        pc_.registerArray(this);
+    }
+
+    template<typename T, typename Storage>
+    template<typename... Args>
+    ParticleArray<T, Storage>::
+    ParticleArray(std::string const& name, ParticleContainer& pc, Args&&... storageArgs)
+      : Storage(std::forward<Args>(storageArgs)...), name_(name), pc_(pc)
+    {
+        this->resize(pc_.capacity());
+        pc_.registerArray(this);
+    }
+
+    template<typename T, typename Storage>
+    ParticleArray<T, Storage>::
+    ParticleArray(ParticleArray const& other)
+      : Storage(other), name_(other.name_), pc_(other.pc_)
+    {
+        pc_.registerArray(this);
+    }
+
+    template<typename T, typename Storage>
+    ParticleArray<T, Storage>::
+    ~ParticleArray()
+    {
+        pc_.unregisterArray(this);
+    }
 }// namespace mpacts
 
 #endif // PARTICLECONTAINER_H
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 
 
 namespace mpi
@@ -13,6 +14,7 @@ namespace mpi
     int size = 1; // just in case mpi::init was not called, used for testing
     std::string INFO;
     std::string dbg_fname;
+    FILE* dbg_file = nullptr;
     int64_t timestamp0;
 
  //---------------------------------------------------------------------------------------------------------------------
@@ -36,6 +38,22 @@ namespace mpi
         ss<<"MPI rank ["<<rank<<'/'<<size<<"] (name='"<<processor_name<<"'):";
         INFO = ss.str();
 
+     // start tracing
+        {
+            unsigned n = (unsigned)log10((float)size) + 2;
+            std::stringstream fname;
+            if( char const* dir = getenv("MPICTS_TRACE_DIR") )
+                fname<<dir<<'/';
+            fname<<std::setfill('_')<<std::setw(n)<<rank<<".trc";
+            if( char const* level = getenv("MPICTS_TRACE_LEVEL") )
+                trace::theTracer.setLevel( (trace::Level) atoi(level) );
+            if( char const* mask = getenv("MPICTS_TRACE_MASK") )
+                trace::theTracer.setMask( (uint32_t) strtoul(mask, nullptr, 0) );
+            if( trace::theTracer.level() != trace::off )
+                trace::theTracer.start(fname.str());
+            trace::record(trace::general, trace::info, trace::init, rank, size);
+        }
+
      // initialize debug output file.
         if constexpr(_debug_)
         {
@@ -49,7 +67,8 @@ namespace mpi
             MPI_Bcast( &timestamp0, 1, MPI_LONG_LONG_INT, 0, MPI_COMM_WORLD );
             int64_t timestamp = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() - timestamp0;
 
-            FILE* fh = fopen(dbg_fname.c_str(), "w");
+            dbg_file = fopen(dbg_fname.c_str(), "w");
+            FILE* fh = dbg_file;
             if(fh==nullptr) {
                 printf("%s failed to open %s file: permission issue?\n", CINFO, dbg_fname.c_str());
                 exit(1);
@@ -62,7 +81,6 @@ namespace mpi
             fprintf(fh, "[%lld]\nmpi::init()\n", timestamp);
             fprintf(fh, "  %s\n", (success==MPI_SUCCESS ? "MPI_Initialize succeeded." : "MPI_Initialize failed."));
             fprintf(fh, "--------------------------------------------------------------------------------\n\n");
-            fclose(fh);
         }
     }
 
@@ -88,7 +106,13 @@ namespace mpi
             std::string msg = (success==MPI_SUCCESS ? "mpi::finalize()\n  MPI_Finalize succeeded."
                                                     : "mpi::finalize()\n  MPI_Finalize failed.");
             prdbg(msg);
+            if( dbg_file ) {
+                fclose(dbg_file);
+                dbg_file = nullptr;
+            }
         }
+        trace::record(trace::general, trace::info, trace::finalize, trace::theTracer.nDropped());
+        trace::theTracer.stop();
     }
 
  //---------------------------------------------------------------------------------------------------------------------
@@ -97,17 +121,23 @@ namespace mpi
     const Lines_t nolines;
     void prdbg(std::string const& s, Lines_t const& lines)
     {
-        FILE* fh = fopen(dbg_fname.c_str(), "a");
-        if(fh==nullptr){printf("%s failed to open .dbg file: permission issue?\n", CINFO); exit(1);}
+        if constexpr(_debug_)
+        {
+            if( dbg_file == nullptr )
+            {// mpi::init() was not called, or mpi::finalize() was already called.
+                dbg_file = fopen(dbg_fname.c_str(), "a");
+                if(dbg_file==nullptr){printf("%s failed to open .dbg file: permission issue?\n", CINFO); exit(1);}
+            }
+            FILE* fh = dbg_file;
 
-        using namespace std::chrono;
-        int64_t timestamp = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() - timestamp0;
-        fprintf(fh, "[%lld]\n%s\n", timestamp, s.c_str());
+            using namespace std::chrono;
+            int64_t timestamp = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() - timestamp0;
+            fprintf(fh, "[%lld]\n%s\n", timestamp, s.c_str());
 
-        for( auto line: lines ) fprintf(fh, "%s\n", line.c_str());
+            for( auto line: lines ) fprintf(fh, "%s\n", line.c_str());
 
-        fprintf(fh, "--------------------------------------------------------------------------------\n\n");
-        fclose(fh);
+            fprintf(fh, "--------------------------------------------------------------------------------\n\n");
+        }
     }
 
 
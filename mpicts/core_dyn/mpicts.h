@@ -9,6 +9,7 @@
 #include <string>
 #include <cstdint>
 
+#include "Trace.h"
 
 #define CINFO INFO.c_str()
 
@@ -22,7 +23,8 @@
 namespace mpi // this code is both for the one-sided approach and for the two-sided approach.
 {//---------------------------------------------------------------------------------------------------------------------
  // A compile time constant restricted to this namespace. Set to true and recompile to produce debug output.
-    bool const _debug_ = true;
+ // (For low overhead tracing that can be switched on at runtime, see Trace.h.)
+    bool const _debug_ = false;
 
  // Global variables set by mpi::init()
     extern int rank;
@@ -39,6 +41,7 @@ namespace mpi // this code is both for the one-sided approach and for the two-si
     using MPITag_t = int;
     using Index_t = int64_t; // copied from Primitives/Types/Index.h
     using Indices_t = std::vector<Index_t>; // list of indices
+    using Id_t = int64_t; // global particle ID, unique across ranks, >= 0
 
  //---------------------------------------------------------------------------------------------------------------------
  // Initialize MPI
@@ -76,6 +79,7 @@ namespace mpi // this code is both for the one-sided approach and for the two-si
  //---------------------------------------------------------------------------------------------------------------------
  // Produce debug output (in file `_<rank>.dbg`). As the order of output in MPI proceses is subject to randomness,
  // prdbg writes to a distinct file per process. The order in the file is not subject to randomness.
+ // The file is opened by mpi::init() and closed by mpi::finalize(). prdbg does nothing if mpi::_debug_ is false.
  // Writes a
  // - timestamp (not necessarily fine grained enough to compare the time of output across different processes
  // - a <title> string
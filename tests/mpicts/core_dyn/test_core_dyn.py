@@ -10,6 +10,7 @@ import sys
 sys.path.insert(0,'.')
 
 import numpy as np
+import pytest
 
 import mpicts
 
@@ -25,6 +26,39 @@ def test_MessageHandler():
 def test_PcMessageHandler():
     cpp.test_PcMessageHandler()
 
+# The C++ tests that return true on success
+@pytest.mark.parametrize("name", [
+    "test_StaticMessage",
+    "test_NestedContainers",
+    "test_PackedFields",
+    "test_Trace",
+    "test_Codec",
+    "test_LossyPrecision",
+    "test_DeltaEncoding",
+    "test_IndexCoding",
+    "test_ParticleMajor",
+    "test_BulkTransfer",
+    "test_VariableLength",
+    "test_AlignedLayout",
+    "test_MessageView",
+    "test_FreeList",
+    "test_AliveMask",
+    "test_Compaction",
+    "test_IdMap",
+    "test_ArraySubsets",
+    "test_Reorder",
+    "test_Reserve",
+    "test_GhostRegion",
+    "test_Handles",
+    "test_LargeIndices",
+    "test_PagedArray",
+    "test_MemoryPolicy",
+])
+def test_cpp(name):
+    if not hasattr(cpp, name):
+        pytest.skip(f"{name} is not in this build (compiled without PC)")
+    assert getattr(cpp, name)()
+
 #===============================================================================
 # The code below is for debugging a particular test in eclipse/pydev.
 # (normally all tests are run with pytest)